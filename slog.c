@@ -5,88 +5,199 @@
  * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
 
 #include <assert.h>
+#include <errno.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "slog.h"
+#include "slog_async.h"
+#include "slog_bin.h"
+#include "slog_buf.h"
+#include "slog_clock.h"
+#include "slog_entry.h"
 #include "slog_fmt.h"
+#include "slog_kv.h"
 #include "slog_log.h"
 #include "slog_mem.h"
+#include "slog_stream.h"
 
 #include "slog_color.h"
 
 #define SLOG_DEFAULT_FORMAT "[%l] %c: %L"
 
-struct slog_stream {
-    /* path to the file */
-    const char *path;
-    /* file descriptor */
-    FILE *file;
-    /* slog_fmt is a stream of tokens containing 
-     * the info about the format */
-    struct slog_fmt *fmt_head;
-    /* redirect to the secondary output */
-    unsigned char to_stdout;
-    /* should the output to stdout be colorized */
-    unsigned char colorized;
-    /* which loglevels should be suppressed */
-    unsigned int suppress;
-};
-
-extern int errno;
+/* free the formats replaced by slog_format (), called with the stream
+ * locked while no thread is formatting */
+static void _slog_fmt_reclaim (slog_stream *stream) {
+    slog_fmt_retired *r = stream->retired, *next;
+    __atomic_store_n (&stream->retired, NULL, __ATOMIC_SEQ_CST);
+    for (; r; r = next) {
+        next = r->next;
+        slog_fmt_clear (r->fmt);
+        slog_mem_free (&stream->alloc, r);
+    }
+}
+
+/* the format of the stream, held until _slog_fmt_put () */
+static slog_fmt *_slog_fmt_get (slog_stream *stream) {
+    atomic_fetch_add (&stream->fmt_users, 1);
+    return atomic_load (&stream->fmt_head);
+}
+
+/* the last thread to stop formatting frees the replaced formats. Any
+ * thread coming after it reads the current format */
+static void _slog_fmt_put (slog_stream *stream) {
+    if (atomic_fetch_sub (&stream->fmt_users, 1) != 1
+            || !__atomic_load_n (&stream->retired, __ATOMIC_SEQ_CST))
+        return;
+    pthread_mutex_lock (&stream->lock);
+    if (!atomic_load (&stream->fmt_users))
+        _slog_fmt_reclaim (stream);
+    pthread_mutex_unlock (&stream->lock);
+}
+
+/* make the stream binary, its file starts a new session */
+static char _slog_bin_start (slog_stream *stream) {
+    if (!stream->file) {
+        slog_log_error ("Binary streams require a file");
+        return 1;
+    }
+    stream->bin = slog_bin_create (&stream->alloc);
+    if (!stream->bin)
+        return 1;
+
+    slog_buf rec;
+    if (slog_buf_init (&rec, NULL, SLOG_BUFSIZ) != 0)
+        return 1;
+    slog_bin_session (&rec, SLOG_DEFAULT_FORMAT);
+    fwrite (rec.data, 1, rec.len, stream->file);
+    /* direct streams write past the FILE buffer */
+    fflush (stream->file);
+    slog_free (rec.data);
+    return 0;
+}
 
 slog_stream *slog_create (const char *path, unsigned int flags) {
-    slog_stream *file = malloc (sizeof (struct slog_stream));
+    return slog_create_with (path, flags, NULL);
+}
+
+slog_stream *slog_create_with (const char *path, unsigned int flags, const slog_allocator *alloc) {
+    if (!alloc)
+        alloc = slog_mem_global ();
+    slog_stream *file = slog_mem_alloc (alloc, sizeof (struct slog_stream));
     if (!file)
         return NULL;
+    file->alloc = *alloc;
 
-    file->to_stdout = !(flags & slog_flags_nostdout);
-    file->colorized =  (flags & slog_flags_color);
+    atomic_init (&file->to_stdout, !(flags & slog_flags_nostdout));
+    /* the terminal is checked once, a redirected stdout costs nothing */
+    atomic_init (&file->colorized, (flags & slog_flags_color) && slog_color_tty ());
     /* we only suppress debug messages by default */
-    file->suppress  = slog_loglevel_debug_s.id;
-    file->fmt_head  = NULL;
+    slog_levelset_mask (file->suppress, slog_loglevel_debug_s.id, 1);
+    memset (&file->head, 0, sizeof (slog_stream_head));
+    file->head.skip[0] = slog_loglevel_debug_s.id;
+    atomic_init (&file->fmt_head, NULL);
+    atomic_init (&file->fmt_users, 0);
+    file->retired = NULL;
+    atomic_init (&file->nsinks, 0);
+    atomic_init (&file->recorder, NULL);
+    file->path = NULL;
+    file->file = NULL;
+    file->has_file = 0;
+    file->ring = NULL;
+    file->timing = (flags & slog_flags_timing) != 0;
+    memset (&file->stats, 0, sizeof (slog_counters));
+    atomic_init (&file->backpressure, slog_backpressure_block);
+    slog_levelset_mask (file->droppable, 0, 1);
+    file->bin  = NULL;
+    file->direct = (flags & slog_flags_direct) != 0;
+    memset (&file->dout, 0, sizeof (slog_buf));
+    memset (&file->dfile, 0, sizeof (slog_buf));
+    memset (&file->map, 0, sizeof (slog_map));
+    file->map.enabled = (flags & slog_flags_mmap) != 0;
+    pthread_mutex_init (&file->lock, NULL);
+    slog_flush_init (file);
+    /* %e counts from the first stream */
+    slog_clock_init ();
+    slog_rotate_init (file);
     slog_format (file, SLOG_DEFAULT_FORMAT);
-    if (!path) {
-        file->path = NULL;
-        file->file = NULL;
-        return file;
-    }
-    const char *mode = (flags & slog_flags_rewrite) ? "w" : "a";
-    file->file = fopen (path, mode);
-    if (!file->file) {
-        slog_log_error ("Failed to open file %s for writing", path);
-        free (file);
+    if (path) {
+        /* mappings require the file to be readable */
+        const char *mode = (flags & slog_flags_rewrite)
+            ? (file->map.enabled ? "w+" : "w")
+            : (file->map.enabled ? "a+" : "a");
+        file->file = fopen (path, mode);
+        if (!file->file) {
+            slog_log_error ("Failed to open file %s for writing", path);
+            slog_close (file);
+            return NULL;
+        }
+        file->has_file = 1;
+        size_t len = strlen (path) + 1;
+        file->path = slog_mem_alloc (&file->alloc, len);
+        if (!file->path) {
+            slog_close (file);
+            return NULL;
+        }
+        memcpy ((char *)file->path, path, len);
+    }
+
+    if (file->map.enabled && !file->has_file) {
+        slog_log_error ("Memory-mapped streams require a file");
+        slog_close (file);
         return NULL;
     }
-    size_t len = strlen (path) + 1;
-    file->path = malloc (len);
-    if (!file->path) {
-        free (file);
-        fclose (file->file);
+    /* whatever stdio holds for stdout goes before the direct entries */
+    if (file->direct)
+        fflush (stdout);
+    if ((flags & slog_flags_binary) && _slog_bin_start (file) != 0) {
+        slog_close (file);
+        return NULL;
+    }
+    if ((flags & slog_flags_async) && slog_async_start (file, SLOG_ASYNC_CAPACITY) != 0) {
+        slog_close (file);
         return NULL;
     }
-
-    memcpy ((char *)file->path, path, len);
     return file;
 }
 slog_stream *slog_desc (FILE *fd) {
     slog_stream *f = slog_create (NULL, slog_flags_none);
+    if (!f)
+        return NULL;
     f->file = fd;
+    f->has_file = fd != NULL;
     return f;
 }
 
 void slog_close (slog_stream *file) {
     assert (file != NULL);
-    if (file->file)
+    slog_flush_stop (file);
+    if (file->ring)
+        slog_async_shutdown (file);
+    slog_recorder_close (file);
+    unsigned int i, n = atomic_load (&file->nsinks);
+    for (i = 0; i < n; ++i)
+        slog_sink_close (file->sinks[i]);
+    if (file->path)
+        slog_rotate_clear (file);
+    if (file->file) {
+        slog_map_close (file);
         fclose (file->file);
+    }
     if (file->path)
-        free ((char *)file->path);
+        slog_mem_free (&file->alloc, (char *)file->path);
     if (file->fmt_head)
         slog_fmt_clear (file->fmt_head);
+    _slog_fmt_reclaim (file);
+    if (file->bin)
+        slog_bin_destroy (file->bin);
+    slog_direct_clear (file);
+    slog_flush_clear (file);
+    pthread_mutex_destroy (&file->lock);
 
-    slog_free (file);
+    slog_allocator alloc = file->alloc;
+    slog_mem_free (&alloc, file);
 }
 
 void slog_printf (slog_stream *stream, const slog_loglevel *level, const char *fmt, ...) {
@@ -99,103 +210,698 @@ void slog_printf (slog_stream *stream, const slog_loglevel *level, const char *f
     va_end (va);
 }
 
-void slog_vprintf (slog_stream *stream, const slog_loglevel *level, const char *fmt, va_list list) {
-#define colorize()\
-    if (stream->colorized) {\
-        slog_set_color (level->color);\
+/* the entry wrapped in the escapes of its level as one piece, the reset goes
+ * before the newline. NULL if the entry is written as it is */
+static slog_buf *_slog_colored (const slog_loglevel *level, const char *entry, size_t len) {
+    if (!level || !len || entry[len - 1] != '\n')
+        return NULL;
+
+    size_t pre, post;
+    const char *prefix = slog_color_code (level->color, &pre);
+    const char *suffix = slog_color_code (slog_color_reset, &post);
+    if (!pre)
+        return NULL;
+
+    /* the entry is never in the scratch buffer, it is free at this point */
+    slog_buf *buf = slog_buf_thread_at (SLOG_BUF_SCRATCH);
+    if (!buf)
+        return NULL;
+    slog_buf_append (buf, prefix, pre);
+    slog_buf_append (buf, entry, len - 1);
+    slog_buf_append (buf, suffix, post);
+    slog_buf_append (buf, "\n", 1);
+    if (buf->failed) {
+        slog_buf_release (buf);
+        return NULL;
+    }
+    return buf;
+}
+
+/* nanoseconds spent writing by the thread, taken out of the formatting time */
+static _Thread_local long long slog_written_ns_;
+
+/* the accounting of a log call (see: slog_stats ()) */
+typedef struct _slog_meter {
+    unsigned long long grown;
+    long long start;
+    long long written;
+} _slog_meter;
+
+static void _slog_meter_start (slog_stream *stream, _slog_meter *m) {
+    m->grown = slog_buf_growths ();
+    if (stream->timing) {
+        m->start   = slog_clock_elapsed ();
+        m->written = slog_written_ns_;
+    }
+}
+
+/* the entry of a log call has been handed to its destinations */
+static void _slog_meter_stop (slog_stream *stream, const slog_loglevel *level, _slog_meter *m) {
+    slog_stream_count (stream, emitted[level->index], 1);
+    unsigned long long grown = slog_buf_growths () - m->grown;
+    if (grown)
+        slog_stream_count (stream, buf_growths, grown);
+    if (stream->timing)
+        slog_stream_count (stream, format_ns,
+                slog_clock_elapsed () - m->start - (slog_written_ns_ - m->written));
+}
+
+/* the start of a write, if the stream is timed */
+#define _slog_write_start(stream) ((stream)->timing ? slog_clock_elapsed () : 0)
+
+static void _slog_write_stop (slog_stream *stream, long long start) {
+    if (!stream->timing)
+        return;
+    long long ns = slog_clock_elapsed () - start;
+    slog_written_ns_ += ns;
+    slog_stream_count (stream, write_ns, ns);
+}
+
+/* write an entry (terminated with a newline) to the outputs of the stream */
+static void _slog_write (slog_stream *stream, const slog_loglevel *level, const char *entry, size_t len) {
+    if (stream->direct) {
+        slog_direct_write (stream, level, entry, len, 0);
+        return;
+    }
+    /* the writer thread of an asynchronous stream flushes by batches */
+    int flush = !stream->ring && slog_flush_due (stream, level);
+    if (slog_stream_stdout (stream)) {
+        slog_buf *colored = slog_stream_colorized (stream) ? _slog_colored (level, entry, len) : NULL;
+        const char *out = colored ? colored->data : entry;
+        size_t n = colored ? colored->len : len;
+        /* a single write keeps the escapes of other threads out */
+        if (fwrite (out, 1, n, stdout) < n)
+            slog_stream_count (stream, write_errors, 1);
+        slog_stream_count (stream, bytes_stdout, n);
+        if (colored)
+            slog_buf_release (colored);
+        if (flush)
+            fflush (stdout);
+    }
+    if (stream->has_file) {
+        unsigned long long flushed = 0;
+        pthread_mutex_lock (&stream->lock);
+        FILE *prev = slog_rotate_check (stream, len);
+        if (stream->map.enabled
+                ? slog_map_write (stream, entry, len) != 0
+                : fwrite (entry, 1, len, stream->file) < len) {
+            slog_stream_count (stream, write_errors, 1);
+            slog_log_error ("Failed to write log entry to %s: %s", stream->path, strerror (errno));
+        }
+        slog_stream_count (stream, bytes_file, len);
+        stream->rot.bytes += len;
+        if (flush)
+            flushed = slog_flush_file (stream);
+        pthread_mutex_unlock (&stream->lock);
+
+        if (prev)
+            slog_rotate_finish (stream, prev);
+        if (flushed && slog_flush_syncs (stream))
+            slog_flush_sync (stream, flushed);
     }
+}
+
+/* write an entry to the sinks in dst */
+static void _slog_write_sinks (slog_stream *stream, unsigned int dst, const char *entry, size_t len) {
+    unsigned int i;
+    for (i = 0; dst >> (i + 1); ++i) {
+        if (!(dst & SLOG_DST_SINK (i)))
+            continue;
+        if (slog_sink_write (stream->sinks[i], entry, len))
+            slog_stream_count (stream, write_errors, 1);
+        slog_stream_count (stream, bytes_sinks[i], len);
+    }
+}
+
+/* slog_ring_writer of the asynchronous streams */
+static void _slog_async_write (void *ctx, const slog_loglevel *level, unsigned int dst,
+        const char *entry, size_t len) {
+    slog_stream *stream = ctx;
+    if (entry) {
+        long long start = _slog_write_start (stream);
+        if ((dst & SLOG_DST_STREAM) && slog_flush_due (stream, level))
+            stream->flush.pending = 1;
+        if (dst & SLOG_DST_STREAM) {
+            if (stream->direct)
+                slog_direct_write (stream, level, entry, len, 1);
+            else
+                _slog_write (stream, level, entry, len);
+        }
+        _slog_write_sinks (stream, dst, entry, len);
+        _slog_write_stop (stream, start);
+        return;
+    }
+
+    /* end of a batch, the queue has room again */
+    unsigned long long dropped = slog_ring_take_dropped (stream->ring);
+    if (dropped)
+        slog_printf (stream, slog_loglevel_warning, "%llu messages dropped", dropped);
+
+    long long start = _slog_write_start (stream);
+    unsigned int i, n = atomic_load_explicit (&stream->nsinks, memory_order_acquire);
+    for (i = 0; i < n; ++i)
+        slog_sink_flush (stream->sinks[i]);
+
+    /* nobody waits for the writer thread, so the buffers may as well
+     * be flushed right away, which serves the flush policy as well */
+    unsigned long long flushed = 0;
+    char due = stream->flush.pending;
+    stream->flush.pending = 0;
+    if (stream->direct)
+        slog_direct_flush (stream);
+    else if (slog_stream_stdout (stream))
+        fflush (stdout);
+    if (stream->has_file && (due || !stream->direct)) {
+        pthread_mutex_lock (&stream->lock);
+        if (due)
+            flushed = slog_flush_file (stream);
+        else
+            fflush (stream->file);
+        pthread_mutex_unlock (&stream->lock);
+    }
+    /* one sync for the batch, before slog_drain () returns */
+    if (flushed && slog_flush_syncs (stream))
+        slog_flush_sync (stream, flushed);
+    _slog_write_stop (stream, start);
+}
+
+/* what the queue does with an entry of a level while it is full */
+static slog_ring_full _slog_ring_full (slog_stream *stream, const slog_loglevel *level) {
+    /* a binary record may define the format of the later ones, an urgent
+     * entry is expected on disk once slog_ring_drain () returns */
+    if (stream->bin || !level || level->unsuppressible || slog_flush_urgent (stream, level))
+        return slog_ring_keep;
+
+    switch (atomic_load_explicit (&stream->backpressure, memory_order_relaxed)) {
+        case slog_backpressure_drop_newest:
+            return slog_ring_drop;
+        case slog_backpressure_drop_oldest:
+            return slog_ring_evict;
+        case slog_backpressure_drop_below:
+            return slog_levelset_has (stream->droppable, level) ? slog_ring_drop : slog_ring_wait;
+        default:
+            return slog_ring_wait;
+    }
+}
+
+/* hand the entry to the writer thread or write it right away
+ * @param dst
+ *   destinations of the entry, SLOG_DST_STREAM and SLOG_DST_SINK () bits */
+static void _slog_emit (slog_stream *stream, const slog_loglevel *level, unsigned int dst,
+        const char *entry, size_t len) {
+    /* recorded right away, so that a crash dump has it */
+    if (dst & SLOG_DST_RECORDER) {
+        slog_recorder_put (atomic_load_explicit (&stream->recorder, memory_order_relaxed), entry, len);
+        slog_stream_count (stream, bytes_recorder, len);
+        if (!(dst &= ~SLOG_DST_RECORDER))
+            return;
+    }
+    if (stream->ring) {
+        /* the writer thread cannot wait for itself */
+        if (slog_ring_is_writer (stream->ring))
+            _slog_async_write (stream, level, dst, entry, len);
+        else if (!slog_ring_push (stream->ring, level, dst, entry, len, _slog_ring_full (stream, level))
+                && slog_flush_urgent (stream, level))
+            /* the writer thread flushes (and syncs) it */
+            slog_ring_drain (stream->ring);
+        return;
+    }
+    long long start = _slog_write_start (stream);
+    if (dst & SLOG_DST_STREAM)
+        _slog_write (stream, level, entry, len);
+    _slog_write_sinks (stream, dst, entry, len);
+    _slog_write_stop (stream, start);
+}
+
+/* slog_bin_emit of the binary streams */
+static void _slog_bin_emit (void *ctx, const char *record, size_t len) {
+    _slog_emit (ctx, NULL, SLOG_DST_STREAM, record, len);
+}
+
+/* the entries go to more than the stream's own outputs */
+#define _slog_fans_out(stream, nsinks)\
+    ((nsinks) || atomic_load_explicit (&(stream)->recorder, memory_order_relaxed))
+
+/* the destinations, which want the entries of a level */
+static unsigned int _slog_dests (slog_stream *stream, const slog_loglevel *level, unsigned int nsinks) {
+#define wants(set) (!slog_levelset_has (set, level) || level->unsuppressible)
+    unsigned int dst = 0, i;
+    if (wants (stream->suppress))
+        dst |= SLOG_DST_STREAM;
+    for (i = 0; i < nsinks; ++i)
+        if (wants (stream->sinks[i]->skip))
+            dst |= SLOG_DST_SINK (i);
+    slog_recorder *rec = atomic_load_explicit (&stream->recorder, memory_order_acquire);
+    if (rec && wants (rec->skip))
+        dst |= SLOG_DST_RECORDER;
+    return dst;
+#undef wants
+}
+
+/* write an entry with an already formatted message (and the fields of a
+ * structured entry) to the stream and its sinks, every distinct format is
+ * rendered once for all of its destinations */
+static void _slog_fanout (slog_stream *stream, slog_site *site, const slog_loglevel *level,
+        const char *message, va_list *kv, unsigned int nsinks) {
+    unsigned int dst = _slog_dests (stream, level, nsinks), pending = dst, i, j;
+    if (!dst)
+        return;
+
+    slog_buf *out = slog_buf_thread ();
+    if (!out) {
+        slog_log_error ("Failed to get a formatted string");
+        return;
+    }
+
+    /* every destination shows the same time */
+    slog_entry e = { level, message, NULL, kv };
+    e.site = site;
+    slog_clock_now (&e.ts);
+    e.has_time    = 1;
+    e.elapsed     = slog_clock_elapsed ();
+    e.has_elapsed = 1;
+
+    slog_fmt *own = _slog_fmt_get (stream);
+    /* the format of destination bit d, the recorder uses the stream's */
+#define fmt_of(d) ((d) && (d) <= nsinks && stream->sinks[(d) - 1]->fmt\
+        ? stream->sinks[(d) - 1]->fmt : own)
+    while (pending) {
+        for (i = 0; !(pending & (1u << i)); ++i)
+            ;
+        slog_fmt *f = fmt_of (i);
+        unsigned int group = 0;
+        for (j = i; j < 32; ++j)
+            if ((pending & (1u << j)) && fmt_of (j) == f)
+                group |= 1u << j;
+        pending &= ~group;
+
+        out->len = 0;
+        if (slog_fmt_entry (out, f, &e) != 0) {
+            slog_log_error ("Failed to get a formatted string");
+            continue;
+        }
+        out->data[out->len++] = '\n';
+        _slog_emit (stream, level, group, out->data, out->len);
+    }
+#undef fmt_of
+    _slog_fmt_put (stream);
+    slog_buf_release (out);
+}
+
+void slog_printf_at (slog_stream *stream, slog_site *site, const slog_loglevel *level,
+        const char *fmt, ...) {
+    assert (stream != NULL);
+    assert (fmt != NULL);
+
+    va_list va;
+    va_start (va, fmt);
+    slog_vprintf_at (stream, site, level, fmt, va);
+    va_end (va);
+}
+
+void slog_vprintf (slog_stream *stream, const slog_loglevel *level, const char *fmt, va_list list) {
+    slog_vprintf_at (stream, NULL, level, fmt, list);
+}
+
+void slog_vprintf_at (slog_stream *stream, slog_site *site, const slog_loglevel *level,
+        const char *fmt, va_list list) {
+/* no output of the stream wants the level */
 #define is_suppressed()\
-    (stream->suppress & level->id && !(level->unsuppressible))
+    (__atomic_load_n (&stream->head.skip[slog_level_word (level)], __ATOMIC_RELAXED)\
+        & slog_level_bit (level) && !(level->unsuppressible))
 
     assert (stream != NULL);
     assert (fmt != NULL);
 
     /* the message should be suppressed */
-    if (is_suppressed ())
+    if (is_suppressed ()) {
+        slog_stream_count (stream, suppressed[level->index], 1);
         return;
+    }
+    _slog_meter m;
+    _slog_meter_start (stream, &m);
 
-    char *end_buf = slog_vfmt_get_str (level, stream->fmt_head, fmt, (va_list *)list);
-    if (!end_buf) {
-        slog_log_error ("Failed to get a formatted string");
+    unsigned int nsinks = atomic_load_explicit (&stream->nsinks, memory_order_acquire);
+    if (_slog_fans_out (stream, nsinks)) {
+        /* the message is formatted once for all destinations */
+        slog_buf *msg = slog_buf_thread_at (SLOG_BUF_MESSAGE);
+        if (!msg) {
+            slog_log_error ("Failed to get a formatted string");
+            return;
+        }
+        va_list vac;
+        va_copy (vac, list);
+        slog_buf_vprintf (msg, fmt, &vac);
+        va_end (vac);
+        slog_buf_terminate (msg);
+        if (!msg->failed) {
+            _slog_fanout (stream, site, level, msg->data, NULL, nsinks);
+            _slog_meter_stop (stream, level, &m);
+        }
+        slog_buf_release (msg);
         return;
     }
 
-    size_t len = strlen (end_buf);
-    if (stream->file) {
-        if (stream->to_stdout) {
-            colorize ();
-            puts (end_buf);
+    /* formatted into the thread's reusable buffer, no allocation
+     * unless the entry outgrows it */
+    slog_buf *out = slog_buf_thread ();
+    va_list vac;
+    char failed = 1;
+    if (out) {
+        va_copy (vac, list);
+        if (stream->bin) {
+            failed = slog_bin_vprintf (stream->bin, out, level, fmt, &vac, _slog_bin_emit, stream);
+        } else {
+            slog_entry e = { level, fmt, &vac };
+            e.site = site;
+            failed = slog_fmt_entry (out, _slog_fmt_get (stream), &e);
+            _slog_fmt_put (stream);
         }
-        end_buf[len] = '\n';
-        if (fwrite (end_buf, 1, len + 1, stream->file) < 0)
-            slog_log_error ("Failed to write log entry to %s: %s", stream->path, strerror (errno));
-    } else {
-        colorize ();
-        puts (end_buf);
+        va_end (vac);
+    }
+    if (failed) {
+        slog_log_error ("Failed to get a formatted string");
+        return;
     }
-    if (stream->colorized)
-        slog_reset_color ();
 
-    slog_free (end_buf);
+    /* the terminating NUL is replaced by the newline */
+    if (!stream->bin)
+        out->data[out->len++] = '\n';
+    _slog_emit (stream, level, SLOG_DST_STREAM, out->data, out->len);
+    _slog_meter_stop (stream, level, &m);
+
+    slog_buf_release (out);
 }  
 
 void slog_puts (slog_stream *stream, const slog_loglevel *level, const char *message) {
+    slog_puts_at (stream, NULL, level, message);
+}
+
+void slog_puts_at (slog_stream *stream, slog_site *site, const slog_loglevel *level,
+        const char *message) {
     assert (stream != NULL);
 
     /* the message should be suppressed */
-    if (is_suppressed ())
+    if (is_suppressed ()) {
+        slog_stream_count (stream, suppressed[level->index], 1);
+        return;
+    }
+    _slog_meter m;
+    _slog_meter_start (stream, &m);
+
+    unsigned int nsinks = atomic_load_explicit (&stream->nsinks, memory_order_acquire);
+    if (_slog_fans_out (stream, nsinks)) {
+        _slog_fanout (stream, site, level, message, NULL, nsinks);
+        _slog_meter_stop (stream, level, &m);
         return;
+    }
 
-    char *end_buf = slog_fmt_get_str (level, stream->fmt_head, message);
-    if (!end_buf) {
+    slog_entry e = { level, message, NULL };
+    e.site = site;
+    slog_buf *out = slog_buf_thread ();
+    char failed = 1;
+    if (out && stream->bin) {
+        failed = slog_bin_puts (stream->bin, out, level, message, _slog_bin_emit, stream);
+    } else if (out) {
+        failed = slog_fmt_entry (out, _slog_fmt_get (stream), &e);
+        _slog_fmt_put (stream);
+    }
+    if (failed) {
         slog_log_error ("Failed to get a formatted string");
         return;
     }
 
-    if (stream->file) {
-        if (stream->to_stdout) {
-            colorize ();
-            puts (end_buf);
+    if (!stream->bin)
+        out->data[out->len++] = '\n';
+    _slog_emit (stream, level, SLOG_DST_STREAM, out->data, out->len);
+    _slog_meter_stop (stream, level, &m);
+
+    slog_buf_release (out);
+}
+
+void slog_render_at (slog_stream *stream, slog_site *site, const slog_loglevel *level,
+        slog_renderer render, const void *ctx) {
+    assert (stream != NULL);
+    assert (render != NULL);
+
+    /* the message should be suppressed */
+    if (is_suppressed ()) {
+        slog_stream_count (stream, suppressed[level->index], 1);
+        return;
+    }
+    _slog_meter m;
+    _slog_meter_start (stream, &m);
+
+    unsigned int nsinks = atomic_load_explicit (&stream->nsinks, memory_order_acquire);
+    if (stream->bin || _slog_fans_out (stream, nsinks)) {
+        /* the message is rendered once, binary streams store it as is */
+        slog_buf *msg = slog_buf_thread_at (SLOG_BUF_MESSAGE);
+        if (!msg) {
+            slog_log_error ("Failed to get a formatted string");
+            return;
         }
+        render (msg, ctx);
+        slog_buf_terminate (msg);
+        if (!msg->failed && !stream->bin) {
+            _slog_fanout (stream, site, level, msg->data, NULL, nsinks);
+            _slog_meter_stop (stream, level, &m);
+        } else if (!msg->failed) {
+            slog_buf *out = slog_buf_thread ();
+            if (out && !slog_bin_puts (stream->bin, out, level, msg->data, _slog_bin_emit, stream)) {
+                _slog_emit (stream, level, SLOG_DST_STREAM, out->data, out->len);
+                _slog_meter_stop (stream, level, &m);
+            } else {
+                slog_log_error ("Failed to get a formatted string");
+            }
+            if (out)
+                slog_buf_release (out);
+        }
+        slog_buf_release (msg);
+        return;
+    }
 
-        fputs (end_buf, stream->file);
-    } else {
-        colorize ();
-        puts (end_buf);
+    /* rendered straight into the thread's reusable buffer */
+    slog_entry e = { level, NULL, NULL };
+    e.site   = site;
+    e.render = render;
+    e.ctx    = ctx;
+    slog_buf *out = slog_buf_thread ();
+    char failed = 1;
+    if (out) {
+        failed = slog_fmt_entry (out, _slog_fmt_get (stream), &e);
+        _slog_fmt_put (stream);
     }
+    if (failed) {
+        slog_log_error ("Failed to get a formatted string");
+        return;
+    }
+
+    out->data[out->len++] = '\n';
+    _slog_emit (stream, level, SLOG_DST_STREAM, out->data, out->len);
+    _slog_meter_stop (stream, level, &m);
+
+    slog_buf_release (out);
+}
 
-    if (stream->colorized)
-        slog_reset_color ();
+void slog_kv (slog_stream *stream, const slog_loglevel *level, const char *message, ...) {
+    assert (stream != NULL);
+    assert (message != NULL);
 
-    slog_free (end_buf);
+    va_list kv;
+    va_start (kv, message);
+    slog_vkv (stream, level, message, kv);
+    va_end (kv);
+}
+
+void slog_vkv (slog_stream *stream, const slog_loglevel *level, const char *message, va_list kv) {
+    assert (stream != NULL);
+    assert (message != NULL);
+
+    if (is_suppressed ()) {
+        slog_stream_count (stream, suppressed[level->index], 1);
+        return;
+    }
+    _slog_meter m;
+    _slog_meter_start (stream, &m);
+
+    va_list vac;
+    va_copy (vac, kv);
+    unsigned int nsinks = atomic_load_explicit (&stream->nsinks, memory_order_acquire);
+    if (_slog_fans_out (stream, nsinks)) {
+        _slog_fanout (stream, NULL, level, message, &vac, nsinks);
+        _slog_meter_stop (stream, level, &m);
+        va_end (vac);
+        return;
+    }
+
+    slog_buf *out = slog_buf_thread ();
+    char failed = 1;
+    if (out && stream->bin) {
+        /* binary records have no fields, the entry is stored as logfmt text */
+        slog_buf *msg = slog_buf_thread_at (SLOG_BUF_MESSAGE);
+        if (msg) {
+            slog_buf_append (msg, message, strlen (message));
+            slog_kv_fields (msg, &vac, slog_kv_logfmt);
+            slog_buf_terminate (msg);
+            failed = msg->failed
+                || slog_bin_puts (stream->bin, out, level, msg->data, _slog_bin_emit, stream);
+            slog_buf_release (msg);
+        }
+    } else if (out) {
+        slog_entry e = { level, message, NULL, &vac };
+        failed = slog_fmt_entry (out, _slog_fmt_get (stream), &e);
+        _slog_fmt_put (stream);
+    }
+    va_end (vac);
+    if (failed) {
+        slog_log_error ("Failed to get a formatted string");
+        return;
+    }
+
+    if (!stream->bin)
+        out->data[out->len++] = '\n';
+    _slog_emit (stream, level, SLOG_DST_STREAM, out->data, out->len);
+    _slog_meter_stop (stream, level, &m);
+
+    slog_buf_release (out);
 }
 
 char slog_format (slog_stream *file, const char *fmt) {
     assert (file != NULL);
     
-    slog_fmt *f = slog_fmt_create (fmt);
+    slog_fmt *f = slog_fmt_create_with (fmt, &file->alloc);
     if (!f)
         return 1;
-    if (file->fmt_head)
-        slog_fmt_clear (file->fmt_head);
-    file->fmt_head = f;
+    slog_fmt_retired *r = slog_mem_alloc (&file->alloc, sizeof (slog_fmt_retired));
+    if (!r) {
+        slog_fmt_clear (f);
+        return 1;
+    }
+
+    /* other threads may still be formatting with the old one, it is freed
+     * now or by the last of them (see: _slog_fmt_put ()) */
+    pthread_mutex_lock (&file->lock);
+    r->fmt  = atomic_exchange (&file->fmt_head, f);
+    r->next = file->retired;
+    if (r->fmt) {
+        __atomic_store_n (&file->retired, r, __ATOMIC_SEQ_CST);
+        r = NULL;
+    }
+    if (!atomic_load (&file->fmt_users))
+        _slog_fmt_reclaim (file);
+    pthread_mutex_unlock (&file->lock);
+    /* the stream had no format yet */
+    if (r)
+        slog_mem_free (&file->alloc, r);
+
+    /* the decoder renders the following entries with this layout */
+    if (file->bin) {
+        slog_buf rec;
+        if (slog_buf_init (&rec, NULL, SLOG_BUFSIZ) != 0)
+            return 1;
+        slog_bin_layout (&rec, fmt);
+        _slog_emit (file, NULL, SLOG_DST_STREAM, rec.data, rec.len);
+        slog_free (rec.data);
+    }
     return 0;
 }
 
 void slog_output_to_stdout (slog_stream *file, unsigned char flag) {
     assert (file != NULL);
-    file->to_stdout = flag;
+    atomic_store_explicit (&file->to_stdout, flag, memory_order_relaxed);
 }
 
 void slog_colorized (slog_stream *file, unsigned char flag) {
-    file->colorized = flag;
+    atomic_store_explicit (&file->colorized, flag, memory_order_relaxed);
 }
 
 void slog_suppress (slog_stream *file, unsigned int mask) {
     assert (file != NULL);
-    file->suppress = mask;
+    pthread_mutex_lock (&file->lock);
+    slog_levelset_mask (file->suppress, mask, 0);
+    slog_stream_update_skip (file);
+    pthread_mutex_unlock (&file->lock);
+}
+void slog_suppress_level (slog_stream *file, const slog_loglevel *level, unsigned char state) {
+    assert (file != NULL);
+    assert (level != NULL);
+    pthread_mutex_lock (&file->lock);
+    slog_levelset_set (file->suppress, level, state);
+    slog_stream_update_skip (file);
+    pthread_mutex_unlock (&file->lock);
 }
 unsigned int slog_get_suppressed (slog_stream *file) {
     assert (file != NULL);
-    return file->suppress;
+    return atomic_load_explicit (&file->suppress[0], memory_order_relaxed);
+}
+
+char slog_async_start (slog_stream *stream, size_t capacity) {
+    assert (stream != NULL);
+    if (stream->ring)
+        return 0;
+
+    stream->ring = slog_ring_create (capacity, &stream->alloc, _slog_async_write, stream);
+    return stream->ring == NULL;
+}
+
+void slog_set_backpressure (slog_stream *stream, slog_backpressure policy, unsigned int mask) {
+    assert (stream != NULL);
+
+    slog_levelset_mask (stream->droppable, mask, 1);
+    atomic_store_explicit (&stream->backpressure, policy, memory_order_relaxed);
+}
+
+unsigned long long slog_dropped (slog_stream *stream, const slog_loglevel *level) {
+    assert (stream != NULL);
+
+    if (!stream->ring)
+        return 0;
+    if (level)
+        return slog_ring_dropped (stream->ring, level->index);
+
+    unsigned long long n = 0;
+    unsigned int i;
+    for (i = 0; i < SLOG_LEVELS_MAX; ++i)
+        n += slog_ring_dropped (stream->ring, i);
+    return n;
+}
+
+void slog_stats (slog_stream *stream, slog_stream_stats *out) {
+    assert (stream != NULL);
+    assert (out != NULL);
+
+#define load(counter) atomic_load_explicit (&stream->stats.counter, memory_order_relaxed)
+    unsigned int i;
+    for (i = 0; i < SLOG_LEVELS_MAX; ++i) {
+        out->emitted[i]    = load (emitted[i]);
+        out->suppressed[i] = load (suppressed[i]);
+    }
+    out->dropped      = slog_dropped (stream, NULL);
+    out->bytes_stdout = load (bytes_stdout);
+    out->bytes_file   = load (bytes_file);
+    for (i = 0; i < SLOG_SINKS_MAX; ++i)
+        out->bytes_sinks[i] = load (bytes_sinks[i]);
+    out->bytes_recorder = load (bytes_recorder);
+    out->write_errors   = load (write_errors);
+    out->flushes        = load (flushes);
+    out->syncs          = load (syncs);
+    out->buf_growths    = load (buf_growths);
+    out->format_ns      = load (format_ns);
+    out->write_ns       = load (write_ns);
+#undef load
+}
+
+void slog_drain (slog_stream *stream) {
+    assert (stream != NULL);
+    if (stream->ring)
+        slog_ring_drain (stream->ring);
+}
+
+void slog_async_shutdown (slog_stream *stream) {
+    assert (stream != NULL);
+    if (!stream->ring)
+        return;
+
+    slog_ring_destroy (stream->ring);
+    stream->ring = NULL;
 }
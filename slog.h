@@ -37,23 +37,58 @@ extern "C" {
 /* Check if the formatting is correct */
 #if defined (__GNUC__) || defined (__MINGW32__) || defined (__MINGW64__)
 #   define __slog_fmt_check(x, y) __attribute__((format(printf, x, y)))
+#   define __slog_sentinel __attribute__((sentinel))
 #   ifndef __slog_noreturn
 #       define __slog_noreturn __attribute__((noreturn))
 #   endif
 #else
 #   define __slog_fmt_check(x, y)
+#   define __slog_sentinel
 #   ifndef __slog_noreturn
 #       define __slog_noreturn
 #   endif
 #endif
 
 #define SLOG_VERSION 103
+#include "slog_alloc.h"
 #include "slog_export.h"
 #include "slog_loglevel.h"
+#include <stdarg.h>
 #include <stdio.h>
 
 typedef struct slog_stream slog_stream;
 
+/* slog_stream_head - the leading part of every slog_stream, it is public
+ * so that the logging macros can test the suppression inline, before
+ * any of their arguments are evaluated */
+typedef struct slog_stream_head {
+    /* loglevels, whose entries are dropped without being formatted, a
+     * bitset by slog_level_word () and slog_level_bit (), changed with
+     * relaxed atomic stores (see: __slog_load ()) */
+    unsigned int skip[SLOG_LEVEL_WORDS];
+} slog_stream_head;
+
+/* relaxed atomic load of a setting, which another thread may change */
+#if defined (__GNUC__) || defined (__clang__)
+#   define __slog_load(x) __atomic_load_n (&(x), __ATOMIC_RELAXED)
+#else
+#   define __slog_load(x) (x)
+#endif
+
+/* log levels in the order of severity (see: SLOG_MIN_LEVEL) */
+#define SLOG_LEVEL_DEBUG   0
+#define SLOG_LEVEL_MESSAGE 1
+#define SLOG_LEVEL_WARNING 2
+#define SLOG_LEVEL_ERROR   3
+
+/* Calls of slog_debug () ... slog_error () below this level are removed
+ * at compile time, their arguments are never evaluated. Define it before
+ * including slog.h, e.g. -DSLOG_MIN_LEVEL=SLOG_LEVEL_WARNING.
+ * slog_fatal () is never removed */
+#ifndef SLOG_MIN_LEVEL
+#   define SLOG_MIN_LEVEL SLOG_LEVEL_DEBUG
+#endif
+
 typedef enum slog_flags {
     /* defaults */
     slog_flags_none = 0,
@@ -61,10 +96,61 @@ typedef enum slog_flags {
     slog_flags_rewrite = (1 << 1),
     /* disable logging to stdout */
     slog_flags_nostdout = (1 << 2),
-    /* colorize the output (if supported) */
-    slog_flags_color = (1 << 3)
+    /* colorize the output to stdout if it is a terminal (see: slog_colorized ()) */
+    slog_flags_color = (1 << 3),
+    /* write the output from a dedicated thread (see: slog_async_start ()) */
+    slog_flags_async = (1 << 4),
+    /* write compact binary records instead of text, the messages are
+     * formatted offline by slog-decode. Requires a path, the
+     * output to stdout is disabled. A format is written to the file once
+     * and identified by its address afterwards, so the formats must be
+     * string literals: a buffer reused for another format, or freed and
+     * reallocated at the same address, is decoded with the old text
+     * without any error. Pass such messages as "%s" instead */
+    slog_flags_binary = (1 << 5),
+    /* bypass stdio: every entry is written to the file descriptors with a
+     * single writev () per destination (color escapes included), and the
+     * writer thread of an asynchronous stream writes a whole batch with
+     * one call. Other output to stdout should not be buffered by stdio
+     * meanwhile, or the two may interleave out of order */
+    slog_flags_direct = (1 << 6),
+    /* write the file through a memory mapping, the file is grown by
+     * preallocated chunks of several megabytes and truncated to its real
+     * length by slog_close (). Requires a path. Until the stream is closed
+     * (or after a crash) the file ends with zero bytes */
+    slog_flags_mmap = (1 << 7),
+    /* measure the time spent formatting and writing the entries (see:
+     * slog_stats ()), costs a few clock reads per entry */
+    slog_flags_timing = (1 << 8)
 } slog_flags;
 
+/* default number of entries in the queue of an asynchronous stream */
+#define SLOG_ASYNC_CAPACITY 1024
+
+/* maximal number of sinks of a stream (see: slog_sink_add ()) */
+#define SLOG_SINKS_MAX 30
+
+/* what a log call does while the queue of an asynchronous stream is full
+ * (see: slog_set_backpressure ()) */
+typedef enum slog_backpressure {
+    /* wait for the writer thread (the default) */
+    slog_backpressure_block,
+    /* drop the entry being logged */
+    slog_backpressure_drop_newest,
+    /* drop the oldest queued entry to make room */
+    slog_backpressure_drop_oldest,
+    /* drop the entry if its level is in the mask, otherwise wait */
+    slog_backpressure_drop_below
+} slog_backpressure;
+
+/* Thread safety: any number of threads may log to the same stream. An
+ * entry is always written as a whole, formatting happens outside of the
+ * stream lock, which is only held while the entry is copied out. The
+ * settings (slog_format (), slog_suppress (), slog_colorized (),
+ * slog_output_to_stdout (), slog_set_rotation (), slog_set_flush ()) may
+ * be changed while other threads are logging. slog_close (), slog_async_start () and
+ * slog_async_shutdown () must not run concurrently with logging. */
+
 /* slog_create - initialize an slog_stream
  * @param path
  *   path to the stream, where the output will be written, can be NULL
@@ -73,6 +159,18 @@ typedef enum slog_flags {
  * @return
  *   valid pointer to slog_stream on success, otherwise NULL */
 SLOG_API slog_stream *slog_create (const char *path, unsigned int flags);
+/* slog_create_with - initialize an slog_stream, which allocates its
+ * memory (the stream, formats, sinks, queue, flight recorder and output
+ * buffers) with an allocator of its own
+ * @param path
+ *   path to the stream, where the output will be written, can be NULL
+ * @param flags
+ *   stream flags
+ * @param alloc
+ *   the allocator (copied), NULL for the global one (see: slog_set_allocator ())
+ * @return
+ *   valid pointer to slog_stream on success, otherwise NULL */
+SLOG_API slog_stream *slog_create_with (const char *path, unsigned int flags, const slog_allocator *alloc);
 /* slog_desc - create an slog_stream structure from an existing FILE
  * @param fd
  *   pointer to the FILE structure
@@ -99,7 +197,8 @@ SLOG_API void slog_puts (slog_stream *stream, const slog_loglevel *level, const
  * @param level
  *   log level of the message
  * @param fmt
- *   message or a formated string (like in printf ())
+ *   message or a formated string (like in printf ()), a string literal
+ *   for binary streams (see: slog_flags_binary)
  * @param ...
  *   variadic arguments for the format string */
 SLOG_API void slog_printf (slog_stream *stream, const slog_loglevel *level, const char *fmt, ...) __slog_fmt_check(3, 4);
@@ -114,7 +213,111 @@ SLOG_API void slog_printf (slog_stream *stream, const slog_loglevel *level, cons
  *   variadic arguments for the format string */
 SLOG_API void slog_vprintf (slog_stream *stream, const slog_loglevel *level, const char *fmt, va_list list);
 
-/* slog_format - set the format string for the slog_stream
+/* slog_site - where a message is logged from, rendered by the tokens
+ * %F (file name), %i (line) and %C (function). The level macros keep
+ * one in a static variable per call site (see: SLOG_SITE) */
+typedef struct slog_site {
+    /* __FILE__ */
+    const char *file;
+    /* the file name without the directories, found on the first use
+     * if the compiler does not provide __FILE_NAME__ */
+    const char *base;
+    unsigned int base_len;
+    /* __func__ */
+    const char *func;
+    unsigned int func_len;
+    unsigned int line;
+} slog_site;
+
+#ifdef __FILE_NAME__
+#   define __slog_file_name __FILE_NAME__, sizeof (__FILE_NAME__) - 1
+#else
+#   define __slog_file_name NULL, 0
+#endif
+/* the initializer of a slog_site for the place it is used at */
+#define SLOG_SITE { __FILE__, __slog_file_name, __func__, sizeof (__func__) - 1, __LINE__ }
+
+/* slog_printf_at - print a formated message logged from a call site
+ * @param stream
+ *   pointer to the slog_stream structure
+ * @param site
+ *   pointer to the slog_site structure, NULL if unknown
+ * @param level
+ *   log level of the message
+ * @param fmt
+ *   message or a formated string (like in printf ())
+ * @param ...
+ *   variadic arguments for the format string
+ * @note
+ *   binary streams do not store the call sites */
+SLOG_API void slog_printf_at (slog_stream *stream, slog_site *site, const slog_loglevel *level,
+        const char *fmt, ...) __slog_fmt_check(4, 5);
+/* slog_vprintf_at - print a formated message logged from a call site (va_list) */
+SLOG_API void slog_vprintf_at (slog_stream *stream, slog_site *site, const slog_loglevel *level,
+        const char *fmt, va_list list);
+/* slog_puts_at - print a string logged from a call site (see: slog_printf_at ()) */
+SLOG_API void slog_puts_at (slog_stream *stream, slog_site *site, const slog_loglevel *level,
+        const char *message);
+
+struct slog_buf;
+/* slog_renderer - writes a message straight into the entry (see: slog_buf.h) */
+typedef void (*slog_renderer) (struct slog_buf *out, const void *ctx);
+/* slog_render_at - print a message rendered by a callback where the layout
+ * places it, with no intermediate copy (see: slog_printf_at ())
+ * @param render
+ *   callback, which appends the message to `out`
+ * @param ctx
+ *   argument passed on to the callback
+ * @note
+ *   the callback may be called more than once for an entry and must not
+ *   log itself */
+SLOG_API void slog_render_at (slog_stream *stream, slog_site *site, const slog_loglevel *level,
+        slog_renderer render, const void *ctx);
+
+/* slog_kv_type - type of the value of a field (see: slog_kv ()) */
+typedef enum slog_kv_type {
+    /* const char * */
+    slog_kv_str = 1,
+    /* long long */
+    slog_kv_int,
+    /* unsigned long long */
+    slog_kv_uint,
+    /* double */
+    slog_kv_double,
+    /* int, written as true/false */
+    slog_kv_bool
+} slog_kv_type;
+
+/* the arguments of a field of slog_kv (), with the value converted
+ * to the type the encoder reads */
+#define SLOG_KV_STR(key, value)    (key), slog_kv_str, (const char *)(value)
+#define SLOG_KV_INT(key, value)    (key), slog_kv_int, (long long)(value)
+#define SLOG_KV_UINT(key, value)   (key), slog_kv_uint, (unsigned long long)(value)
+#define SLOG_KV_DOUBLE(key, value) (key), slog_kv_double, (double)(value)
+#define SLOG_KV_BOOL(key, value)   (key), slog_kv_bool, (int)!!(value)
+
+/* slog_kv - print a structured entry: a plain message and typed fields.
+ * The fields are encoded straight into the output, as a JSON object by
+ * the token %J, as logfmt by %K and after the message by %L, e.g.
+ *   slog_kv (stream, slog_loglevel_message, "request done",
+ *            SLOG_KV_STR ("path", path), SLOG_KV_INT ("status", 200), NULL);
+ * @param stream
+ *   pointer to the slog_stream structure
+ * @param level
+ *   log level of the message
+ * @param message
+ *   the message (not a format)
+ * @param ...
+ *   fields as (const char *key, slog_kv_type type, value), terminated
+ *   with NULL, best written with the SLOG_KV_* () macros. In logfmt the
+ *   spaces, control characters, '=', '"' and '\\' of a key are written as '_' */
+SLOG_API void slog_kv (slog_stream *stream, const slog_loglevel *level, const char *message, ...) __slog_sentinel;
+/* slog_vkv - print a structured entry (va_list, see: slog_kv ()) */
+SLOG_API void slog_vkv (slog_stream *stream, const slog_loglevel *level, const char *message, va_list kv);
+
+/* slog_format - set the format string for the slog_stream. The threads
+ * logging meanwhile may go on with the old format, which is freed once
+ * none of them is formatting an entry
  * @param stream
  *   pointer to the string slog_stream structure
  * @param fmt
@@ -130,7 +333,8 @@ SLOG_API char slog_format (slog_stream *stream, const char *fmt);
  *   state (0, 1) */
 SLOG_API void slog_output_to_stdout (slog_stream *stream, unsigned char state);
 
-/* slog_colorized - set the colorized flag
+/* slog_colorized - set the colorized flag, unlike slog_flags_color this
+ * colorizes stdout even if it is not a terminal
  * @param stream
  *   pointer to the slog_stream structure
  * @param state
@@ -143,24 +347,409 @@ SLOG_API void slog_colorized (slog_stream *stream, unsigned char state);
  * @param mask
  *   selected loglevels to be suppressed
  * @note
- *   slog_loglevel_fatal cannot be suppressed */
+ *   the mask only covers the first 32 loglevels (those with an id),
+ *   the others are left as they are */
 SLOG_API void slog_suppress (slog_stream *stream, unsigned int mask);
+/* slog_suppress_level - suppress a single loglevel or write it again,
+ * for any registered loglevel
+ * @param stream
+ *   pointer to the slog_stream structure
+ * @param level
+ *   the loglevel
+ * @param state
+ *   suppress (1) or write (0) the entries of the level */
+SLOG_API void slog_suppress_level (slog_stream *stream, const slog_loglevel *level, unsigned char state);
 /* slog_get_suppressed - get suppressed loglevels
  * @param stream
  *   pointer to the slog_stream structure
  * @return
- *   suppressed levels */
+ *   suppressed levels among the first 32 */
 SLOG_API unsigned int slog_get_suppressed (slog_stream *stream);
 
-#include <stdarg.h>
+/* slog_stream_stats - counters of a stream since its creation (see: slog_stats ()) */
+typedef struct slog_stream_stats {
+    /* entries logged, by the index of their level (see: slog_loglevel_get ()) */
+    unsigned long long emitted[SLOG_LEVELS_MAX];
+    /* entries of suppressed levels passed to slog, the logging macros
+     * discard them inline and do not count them */
+    unsigned long long suppressed[SLOG_LEVELS_MAX];
+    /* entries dropped by a full queue (see: slog_dropped ()) */
+    unsigned long long dropped;
+    /* bytes handed to each destination */
+    unsigned long long bytes_stdout;
+    unsigned long long bytes_file;
+    unsigned long long bytes_sinks[SLOG_SINKS_MAX];
+    unsigned long long bytes_recorder;
+    /* failed writes */
+    unsigned long long write_errors;
+    /* flushes of the file and fdatasync () calls (see: slog_set_flush ()) */
+    unsigned long long flushes;
+    unsigned long long syncs;
+    /* reallocations of the buffers the entries are formatted into */
+    unsigned long long buf_growths;
+    /* nanoseconds spent formatting the entries (queueing included) and
+     * writing them out (by the writer thread of an asynchronous stream),
+     * measured with slog_flags_timing only */
+    unsigned long long format_ns;
+    unsigned long long write_ns;
+} slog_stream_stats;
+
+/* slog_stats - get the counters of a stream. They are updated with
+ * relaxed atomic operations, so the values read while other threads
+ * are logging need not be consistent with each other
+ * @param stream
+ *   pointer to the slog_stream structure
+ * @param out
+ *   where the counters are stored */
+SLOG_API void slog_stats (slog_stream *stream, slog_stream_stats *out);
+
+/* slog_sink_add - add a destination to the stream: the entries of the
+ * stream are also written to the file of the sink. The message of an
+ * entry is formatted once for all destinations, and so is each distinct
+ * format
+ * @param stream
+ *   pointer to the slog_stream structure
+ * @param path
+ *   path to the file of the sink
+ * @param flags
+ *   slog_flags_rewrite or slog_flags_none
+ * @param fmt
+ *   format of the sink, NULL for the format of the stream
+ * @param suppress
+ *   loglevels, which are not written to the sink
+ * @return
+ *   index of the sink, -1 on failure
+ * @note
+ *   the sinks are closed with the stream, binary streams cannot have sinks */
+SLOG_API int slog_sink_add (slog_stream *stream, const char *path, unsigned int flags,
+        const char *fmt, unsigned int suppress);
+/* slog_sink_desc - add an existing FILE (e.g. stderr) as a destination of
+ * the stream, the FILE is not closed with the stream (see: slog_sink_add ())
+ * @return
+ *   index of the sink, -1 on failure */
+SLOG_API int slog_sink_desc (slog_stream *stream, FILE *fd, const char *fmt, unsigned int suppress);
+/* slog_sink_suppress - set the loglevels, which are not written to a sink
+ * @param stream
+ *   pointer to the slog_stream structure
+ * @param sink
+ *   index of the sink
+ * @param mask
+ *   selected loglevels to be suppressed */
+SLOG_API void slog_sink_suppress (slog_stream *stream, int sink, unsigned int mask);
+/* slog_sink_suppress_level - suppress a single loglevel of a sink or write
+ * it again (see: slog_suppress_level ()) */
+SLOG_API void slog_sink_suppress_level (slog_stream *stream, int sink, const slog_loglevel *level,
+        unsigned char state);
+
+/* slog_recorder_start - keep the last entries of the stream in memory,
+ * including the loglevels suppressed for its outputs. Recording an entry
+ * only costs a copy, the entries are written out by slog_recorder_dump (),
+ * slog_fatal () or the handler of slog_recorder_on_signal ()
+ * @param stream
+ *   pointer to the slog_stream structure
+ * @param size
+ *   size of the ring in bytes (rounded up to a power of 2)
+ * @param suppress
+ *   loglevels, which are not recorded (e.g. SLOG_SUPPRESS_NOTHING)
+ * @return
+ *   0 on success, non-zero otherwise
+ * @note
+ *   the suppressed levels are formatted for the recorder, binary streams
+ *   cannot have a recorder */
+SLOG_API char slog_recorder_start (slog_stream *stream, size_t size, unsigned int suppress);
+/* slog_recorder_dump - write the recorded entries to the file of the
+ * stream (stdout without a file), after everything logged so far
+ * @param stream
+ *   pointer to the slog_stream structure */
+SLOG_API void slog_recorder_dump (slog_stream *stream);
+/* slog_recorder_on_signal - install a handler, which dumps the recorders
+ * of all streams and then lets the signal take its default action (e.g.
+ * for SIGSEGV and SIGABRT). Mapped files are dumped to stderr
+ * @param sig
+ *   signal number
+ * @return
+ *   0 on success, non-zero otherwise */
+SLOG_API char slog_recorder_on_signal (int sig);
+
+/* slog_async_start - make the stream asynchronous: log calls only copy
+ * the formatted entry into a bounded queue, and a dedicated writer thread
+ * performs the output
+ * @param stream
+ *   pointer to the slog_stream structure
+ * @param capacity
+ *   number of entries in the queue (rounded up to a power of 2), the
+ *   callers block while the queue is full (see: slog_set_backpressure ())
+ * @return
+ *   0 on success, non-zero otherwise */
+SLOG_API char slog_async_start (slog_stream *stream, size_t capacity);
+/* slog_set_backpressure - choose what happens to the entries logged while
+ * the queue of an asynchronous stream is full. The entries of unsuppressible
+ * levels, binary records and the entries flushed by the levels of the flush
+ * policy always wait, and are not dropped later to make room for the
+ * others. The writer thread reports the
+ * number of dropped entries with a warning "N messages dropped" once the
+ * queue has room again
+ * @param stream
+ *   pointer to the slog_stream structure
+ * @param policy
+ *   the policy
+ * @param mask
+ *   loglevels below the severity, which may be dropped with
+ *   slog_backpressure_drop_below (e.g. slog_loglevel_debug_s.id |
+ *   slog_loglevel_message_s.id), ignored by the other policies */
+SLOG_API void slog_set_backpressure (slog_stream *stream, slog_backpressure policy, unsigned int mask);
+/* slog_dropped - get the number of entries dropped by the queue of an
+ * asynchronous stream
+ * @param stream
+ *   pointer to the slog_stream structure
+ * @param level
+ *   count the entries of this level only, NULL for all of them
+ * @return
+ *   the count since slog_async_start () */
+SLOG_API unsigned long long slog_dropped (slog_stream *stream, const slog_loglevel *level);
+/* slog_drain - wait until every entry logged so far has been written
+ * @param stream
+ *   pointer to the slog_stream structure
+ * @note
+ *   does nothing for synchronous streams */
+SLOG_API void slog_drain (slog_stream *stream);
+/* slog_async_shutdown - write out the queued entries, stop the writer
+ * thread and make the stream synchronous again
+ * @param stream
+ *   pointer to the slog_stream structure
+ * @note
+ *   called by slog_close (), no other thread may log to the stream
+ *   while it runs */
+SLOG_API void slog_async_shutdown (slog_stream *stream);
+
+/* slog_rotation - rotation policy of a stream (see: slog_set_rotation ()) */
+typedef struct slog_rotation {
+    /* rotate before the file would grow beyond this size in bytes, 0 - never */
+    unsigned long long max_bytes;
+    /* rotate this many seconds after the file was opened, 0 - never */
+    unsigned long interval;
+    /* number of rotated files to keep ("<path>.1" is the newest), at least 1 */
+    unsigned int max_files;
+} slog_rotation;
+
+/* slog_set_rotation - rotate the file of the stream by a policy. The
+ * successor of the file is pre-opened as "<path>.next", so the writers only
+ * wait for a few renames when the files are switched
+ * @param stream
+ *   pointer to the slog_stream structure
+ * @param policy
+ *   rotation policy (copied), NULL disables the rotation
+ * @return
+ *   0 on success, non-zero otherwise
+ * @note
+ *   only text streams created with a path can be rotated */
+SLOG_API char slog_set_rotation (slog_stream *stream, const slog_rotation *policy);
+/* slog_rotate - rotate the file of the stream right away
+ * @param stream
+ *   pointer to the slog_stream structure
+ * @return
+ *   0 on success, non-zero otherwise */
+SLOG_API char slog_rotate (slog_stream *stream);
+/* slog_reopen - reopen the path of the stream, e.g. after the file was
+ * moved away by an external tool. The entries written so far go to
+ * the old file, none of them are lost
+ * @param stream
+ *   pointer to the slog_stream structure
+ * @return
+ *   0 on success, non-zero otherwise */
+SLOG_API char slog_reopen (slog_stream *stream);
+/* slog_reopen_on_signal - install a handler, which makes every stream
+ * reopen its path before writing the next entry (e.g. for SIGHUP)
+ * @param sig
+ *   signal number
+ * @return
+ *   0 on success, non-zero otherwise */
+SLOG_API char slog_reopen_on_signal (int sig);
+
+/* slog_flush_policy - when the output of a stream is flushed, beyond the
+ * buffering of stdio (see: slog_set_flush ()) */
+typedef struct slog_flush_policy {
+    /* flush after every n-th entry, 0 - never */
+    unsigned int entries;
+    /* flush every this many milliseconds, if anything was written, also
+     * while no more entries come, 0 - never */
+    unsigned int interval_ms;
+    /* flush right after the entries of these loglevels (a mask of ids, e.g.
+     * slog_loglevel_error_s.id | slog_loglevel_fatal_s.id), 0 - none */
+    unsigned int levels;
+    /* also fdatasync () the file, the log call returns once its entry is on
+     * disk. Concurrent callers share a single sync (group commit) */
+    unsigned char sync;
+} slog_flush_policy;
+
+/* slog_set_flush - flush the file (and stdout) of the stream by a policy.
+ * The entries of the levels of the policy are written out (and synced)
+ * before the log call returns, on asynchronous streams the caller waits
+ * for the writer thread. A rotation syncs the file it replaces
+ * @param stream
+ *   pointer to the slog_stream structure
+ * @param policy
+ *   flush policy (copied), NULL leaves the flushing to stdio
+ * @return
+ *   0 on success, non-zero otherwise
+ * @note
+ *   only streams writing to a regular file can be synced. The interval is
+ *   kept by a thread of the stream, which runs while the policy has one */
+SLOG_API char slog_set_flush (slog_stream *stream, const slog_flush_policy *policy);
+/* slog_flush - write out everything logged to the stream so far, its
+ * sinks included
+ * @param stream
+ *   pointer to the slog_stream structure
+ * @param sync
+ *   also wait until the file is on disk (shared with concurrent syncs)
+ * @return
+ *   0 on success, non-zero otherwise */
+SLOG_API char slog_flush (slog_stream *stream, char sync);
+
+/* slog_clock - source of the entry timestamps (see: slog_set_clock ()) */
+typedef enum slog_clock {
+    /* clock_gettime (CLOCK_REALTIME), the default */
+    slog_clock_realtime,
+    /* CLOCK_REALTIME_COARSE, cheaper to read, but only advances once per
+     * scheduler tick (1-4 ms) */
+    slog_clock_coarse,
+    /* the CPU's time stamp counter, calibrated against the system clock,
+     * read in a few nanoseconds. Requires an invariant TSC (x86-64), does
+     * not follow later adjustments of the system clock */
+    slog_clock_tsc
+} slog_clock;
+
+/* slog_set_clock - select the clock source of the timestamps of all
+ * streams, including the monotonic elapsed time (%e)
+ * @param clock
+ *   the clock source
+ * @return
+ *   0 on success, non-zero if the source is not available */
+SLOG_API char slog_set_clock (slog_clock clock);
+
+/* slog_limit_kind - how a call site is limited (see: slog_limit) */
+typedef enum slog_limit_kind {
+    /* at most n entries per second, with bursts of up to n entries */
+    slog_limit_rate = 1,
+    /* every n-th occurrence */
+    slog_limit_every,
+    /* each occurrence with a probability of n / (2^32 - 1) */
+    slog_limit_sample
+} slog_limit_kind;
+
+/* slog_limit - the rate limit of a call site, a zero n disables a rate or
+ * an every limit, while a sample limit with a zero n drops every occurrence.
+ * Initialize it with SLOG_LIMIT_RATE (), SLOG_LIMIT_EVERY () or
+ * SLOG_LIMIT_SAMPLE (), the state is updated atomically, so a limit
+ * may be shared by the threads and the streams. Each dropped occurrence
+ * adds to the shared `dropped` count */
+typedef struct slog_limit {
+    slog_limit_kind kind;
+    unsigned int n;
+    /* the theoretical arrival time (rate) or the occurrence count (every) */
+    unsigned long long state;
+    /* occurrences dropped since the last entry, which passed */
+    unsigned long long dropped;
+} slog_limit;
+
+#define SLOG_LIMIT_RATE(per_second) { slog_limit_rate, (per_second), 0, 0 }
+#define SLOG_LIMIT_EVERY(n)         { slog_limit_every, (n), 0, 0 }
+/* the probability p is a constant between 0 and 1, one below 2^-32 is 0 */
+#define SLOG_LIMIT_SAMPLE(p)        { slog_limit_sample, (unsigned int)((p) * 4294967295.0), 0, 0 }
+
+/* slog_limit_pass - count an occurrence of a limited call site
+ * @param limit
+ *   pointer to the slog_limit structure
+ * @param dropped
+ *   where the number of occurrences dropped since the last one, which
+ *   passed, is stored (may be NULL)
+ * @return
+ *   non-zero if the occurrence should be logged */
+SLOG_API int slog_limit_pass (slog_limit *limit, unsigned long long *dropped);
+/* slog_printf_limited - print a formatted message, unless the limit drops
+ * it. The limit is checked before the message is formatted, an entry
+ * following dropped ones ends with " [<count> dropped]"
+ * @param stream
+ *   pointer to the slog_stream structure
+ * @param limit
+ *   pointer to the slog_limit structure of the call site
+ * @param level
+ *   log level of the message
+ * @param fmt
+ *   format string
+ * @param ...
+ *   variadic arguments for the format string */
+SLOG_API void slog_printf_limited (slog_stream *stream, slog_limit *limit, const slog_loglevel *level,
+        const char *fmt, ...) __slog_fmt_check(4, 5);
+/* slog_vprintf_limited - va_list version of slog_printf_limited () */
+SLOG_API void slog_vprintf_limited (slog_stream *stream, slog_limit *limit, const slog_loglevel *level,
+        const char *fmt, va_list list);
+/* slog_printf_dropped - print a formatted message, which passed a limit,
+ * with the number of the dropped ones (see: slog_limit_pass ())
+ * @param dropped
+ *   the count reported by slog_limit_pass (), nothing is added if 0 */
+SLOG_API void slog_printf_dropped (slog_stream *stream, const slog_loglevel *level,
+        unsigned long long dropped, const char *fmt, ...) __slog_fmt_check(4, 5);
+
 #include <stdlib.h>
 
-#define slog_message(stream, ...) { slog_printf (stream, slog_loglevel_message, __VA_ARGS__); }
-#define slog_warning(stream, ...) { slog_printf (stream, slog_loglevel_warning, __VA_ARGS__); }
-#define slog_error(stream, ...)   { slog_printf (stream, slog_loglevel_error, __VA_ARGS__); }
-#define slog_debug(stream, ...)   { slog_printf (stream, slog_loglevel_debug, __VA_ARGS__); }
+/* slog_enabled - check if the entries of a loglevel would be written,
+ * so that the arguments of a message need not be computed otherwise
+ * @param stream
+ *   pointer to the slog_stream structure
+ * @param level
+ *   log level of the message
+ * @return
+ *   non-zero if the entries of the level are written */
+static __slog_inline int slog_enabled (const slog_stream *stream, const slog_loglevel *level) {
+    return !(__slog_load (((const slog_stream_head *)stream)->skip[slog_level_word (level)])
+            & slog_level_bit (level)) || level->unsuppressible;
+}
+
+/* the arguments are only evaluated, if the level is enabled */
+#define __slog_log(stream, level, ...) do {\
+    if (slog_enabled (stream, level)) {\
+        static slog_site __slog_here = SLOG_SITE;\
+        slog_printf_at (stream, &__slog_here, level, __VA_ARGS__);\
+    }\
+} while (0)
+#define __slog_nolog(stream) do { (void)(stream); } while (0)
+
+/* slog_limited - log with a limit of its own for this call site, e.g.
+ *   slog_limited (stream, slog_loglevel_error, SLOG_LIMIT_RATE (10),
+ *                 "request %d failed", id);
+ * the arguments are only evaluated, if the level is enabled and the
+ * limit lets the entry pass */
+#define slog_limited(stream, level, limit, ...) do {\
+    static slog_limit __slog_site = limit;\
+    unsigned long long __slog_dropped;\
+    if (slog_enabled (stream, level) && slog_limit_pass (&__slog_site, &__slog_dropped))\
+        slog_printf_dropped (stream, level, __slog_dropped, __VA_ARGS__);\
+} while (0)
+
+#if SLOG_MIN_LEVEL <= SLOG_LEVEL_MESSAGE
+#   define slog_message(stream, ...) __slog_log (stream, slog_loglevel_message, __VA_ARGS__)
+#else
+#   define slog_message(stream, ...) __slog_nolog (stream)
+#endif
+#if SLOG_MIN_LEVEL <= SLOG_LEVEL_WARNING
+#   define slog_warning(stream, ...) __slog_log (stream, slog_loglevel_warning, __VA_ARGS__)
+#else
+#   define slog_warning(stream, ...) __slog_nolog (stream)
+#endif
+#if SLOG_MIN_LEVEL <= SLOG_LEVEL_ERROR
+#   define slog_error(stream, ...)   __slog_log (stream, slog_loglevel_error, __VA_ARGS__)
+#else
+#   define slog_error(stream, ...)   __slog_nolog (stream)
+#endif
+#if SLOG_MIN_LEVEL <= SLOG_LEVEL_DEBUG
+#   define slog_debug(stream, ...)   __slog_log (stream, slog_loglevel_debug, __VA_ARGS__)
+#else
+#   define slog_debug(stream, ...)   __slog_nolog (stream)
+#endif
 
-/* slog_fatal - print a fatal error message and exit the program with "status"
+/* slog_fatal - print a fatal error message, dump the flight recorder (if
+ * any) and exit the program with "status"
  * @param stream
  *   pointer to slog_stream structure
  * @param status
@@ -174,6 +763,8 @@ __slog_noreturn static __slog_inline __slog_fmt_check(3, 4) void slog_fatal (slo
     va_start (list, fmt);
     slog_vprintf (stream, slog_loglevel_fatal, fmt, list);
     va_end (list);
+    slog_drain (stream);
+    slog_recorder_dump (stream);
     exit (status);
 }
 
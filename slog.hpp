@@ -0,0 +1,578 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+/* slog.hpp - C++17 front end of slog (header only)
+ *
+ * The message format is a string literal with printf () conversions,
+ * which is parsed and checked against the types of the arguments at
+ * compile time:
+ *
+ *     SLOG_LOG (stream, slog_loglevel_message, "user %s has %d items", name, n);
+ *     slog::warning (stream, SLOG_STR ("%.3f ms"), elapsed);
+ *
+ * At run time the arguments are written by their type from the parsed
+ * conversions, without va_list and without looking at the format again,
+ * straight into the entry of the stream (see: slog_render_at ()).
+ * Supported: flags "-+ #0", a width and a precision (but not '*'), the
+ * length modifiers are accepted and ignored. Integers (and enums) take
+ * d i u o x X c, char also takes c, bool takes d i u s ("true"/"false"),
+ * floating point values f F e E g G a A, strings (const char *,
+ * std::string, std::string_view) s and other pointers p. %n is rejected.
+ * The layout of a stream can be checked the same way (see: slog::format ()). */
+
+#ifndef __SLOG_HPP__
+#define __SLOG_HPP__
+
+#include "slog.h"
+#include "slog_buf.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace slog {
+namespace detail {
+
+/* a conversion of the message format, with the literal text before it */
+struct conv {
+    unsigned int lit_off;
+    unsigned int lit_len;
+    /* the conversion character, '%' for "%%" */
+    char type;
+    unsigned char flags;
+    /* -1 if not given */
+    int width;
+    int prec;
+};
+
+enum : unsigned char {
+    flag_left  = 1,
+    flag_plus  = 2,
+    flag_space = 4,
+    flag_alt   = 8,
+    flag_zero  = 16
+};
+
+/* the conversions an argument may be written with */
+enum class kind {
+    none,
+    boolean,
+    character,
+    integer,
+    floating,
+    string,
+    pointer
+};
+
+template <typename T>
+constexpr kind kind_of () {
+    using D = std::decay_t<T>;
+    if constexpr (std::is_same_v<D, bool>)
+        return kind::boolean;
+    else if constexpr (std::is_same_v<D, char>)
+        return kind::character;
+    else if constexpr (std::is_integral_v<D> || std::is_enum_v<D>)
+        return kind::integer;
+    else if constexpr (std::is_floating_point_v<D>)
+        return kind::floating;
+    else if constexpr (std::is_convertible_v<const D &, std::string_view>)
+        return kind::string;
+    else if constexpr (std::is_pointer_v<D> || std::is_null_pointer_v<D>)
+        return kind::pointer;
+    else
+        return kind::none;
+}
+
+constexpr bool accepts (kind k, char type) {
+    switch (k) {
+        case kind::boolean:
+            return type == 'd' || type == 'i' || type == 'u' || type == 's';
+        case kind::character:
+        case kind::integer:
+            return type == 'd' || type == 'i' || type == 'u' || type == 'o'
+                || type == 'x' || type == 'X' || type == 'c';
+        case kind::floating:
+            return type == 'f' || type == 'F' || type == 'e' || type == 'E'
+                || type == 'g' || type == 'G' || type == 'a' || type == 'A';
+        case kind::string:
+            return type == 's';
+        case kind::pointer:
+            return type == 'p';
+        default:
+            return false;
+    }
+}
+
+/* returned by count () for a malformed format */
+constexpr std::size_t bad = static_cast<std::size_t> (-1);
+
+constexpr bool is_digit (char c) {
+    return c >= '0' && c <= '9';
+}
+
+/* parse the conversion after the '%' at s[i]
+ * @return
+ *   the index past the conversion, 0 if it is malformed */
+constexpr std::size_t parse_conv (const char *s, std::size_t i, conv &c) {
+    c.flags = 0;
+    c.width = -1;
+    c.prec  = -1;
+    if (s[i] == '%') {
+        c.type = '%';
+        return i + 1;
+    }
+    for (bool more = true; more; ) {
+        switch (s[i]) {
+            case '-': c.flags |= flag_left;  ++i; break;
+            case '+': c.flags |= flag_plus;  ++i; break;
+            case ' ': c.flags |= flag_space; ++i; break;
+            case '#': c.flags |= flag_alt;   ++i; break;
+            case '0': c.flags |= flag_zero;  ++i; break;
+            default:  more = false; break;
+        }
+    }
+    if (is_digit (s[i])) {
+        c.width = 0;
+        while (is_digit (s[i]))
+            c.width = c.width * 10 + (s[i++] - '0');
+    }
+    if (s[i] == '.') {
+        c.prec = 0;
+        ++i;
+        while (is_digit (s[i]))
+            c.prec = c.prec * 10 + (s[i++] - '0');
+    }
+    /* the types of the arguments are known */
+    while (s[i] == 'h' || s[i] == 'l' || s[i] == 'L' || s[i] == 'q'
+            || s[i] == 'j' || s[i] == 'z' || s[i] == 't')
+        ++i;
+
+    switch (s[i]) {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        case 's': case 'p':
+            c.type = s[i];
+            return i + 1;
+        default:
+            return 0;
+    }
+}
+
+/* number of conversions of a format, "%%" included, or `bad` */
+constexpr std::size_t count (const char *s) {
+    std::size_t n = 0, i = 0;
+    while (s[i]) {
+        if (s[i++] != '%')
+            continue;
+        conv c {};
+        i = parse_conv (s, i, c);
+        if (!i)
+            return bad;
+        ++n;
+    }
+    return n;
+}
+
+/* do the arguments match the conversions of a format */
+template <typename... Args>
+constexpr bool check (const char *s) {
+    constexpr kind kinds[] = { kind_of<Args> ()..., kind::none };
+    std::size_t k = 0, i = 0;
+    while (s[i]) {
+        if (s[i++] != '%')
+            continue;
+        conv c {};
+        i = parse_conv (s, i, c);
+        if (!i)
+            return false;
+        if (c.type == '%')
+            continue;
+        if (k == sizeof... (Args) || !accepts (kinds[k++], c.type))
+            return false;
+    }
+    return k == sizeof... (Args);
+}
+
+/* a format parsed at compile time, N conversions and the trailing literal */
+template <std::size_t N>
+struct parsed {
+    conv convs[N ? N : 1];
+    unsigned int tail_off;
+    unsigned int tail_len;
+};
+
+template <std::size_t N>
+constexpr parsed<N> parse (const char *s) {
+    parsed<N> p {};
+    std::size_t n = 0, i = 0, lit = 0;
+    while (s[i]) {
+        if (s[i] != '%') {
+            ++i;
+            continue;
+        }
+        conv &c = p.convs[n++];
+        c.lit_off = static_cast<unsigned int> (lit);
+        c.lit_len = static_cast<unsigned int> (i - lit);
+        i = parse_conv (s, i + 1, c);
+        lit = i;
+    }
+    p.tail_off = static_cast<unsigned int> (lit);
+    p.tail_len = static_cast<unsigned int> (i - lit);
+    return p;
+}
+
+/* is a layout of a stream (see: slog_format ()) valid */
+constexpr bool check_layout (const char *s) {
+    constexpr std::string_view tokens = "chHmsdMyYpPfuNTeJKFiClL";
+    for (std::size_t i = 0; s[i]; ++i) {
+        if (s[i] != '%')
+            continue;
+        char t = s[++i];
+        if (!t)
+            return true;
+        if (t != '%' && t != ' ' && tokens.find (t) == std::string_view::npos)
+            return false;
+    }
+    return true;
+}
+
+/* the output keeps the rules of slog_buf: len counts every byte, even
+ * past the end of a fixed buffer, which is then only filled up */
+inline void append (slog_buf &out, const char *s, std::size_t n) {
+    if (out.len + n < out.size) {
+        std::memcpy (out.data + out.len, s, n);
+        out.len += n;
+    } else {
+        slog_buf_append (&out, s, n);
+    }
+}
+
+/* append `n` copies of `c` */
+inline void fill (slog_buf &out, char c, std::size_t n) {
+    if (!n)
+        return;
+    std::size_t room = out.len + n < out.size ? n : slog_buf_reserve (&out, n);
+    if (room)
+        std::memset (out.data + out.len, c, room);
+    out.len += n;
+}
+
+/* the text, padded to the width of a conversion */
+inline void put_padded (slog_buf &out, const conv &c, const char *s, std::size_t n) {
+    std::size_t pad = c.width > 0 && static_cast<std::size_t> (c.width) > n ? c.width - n : 0;
+    if (!(c.flags & flag_left))
+        fill (out, ' ', pad);
+    append (out, s, n);
+    if (c.flags & flag_left)
+        fill (out, ' ', pad);
+}
+
+inline void put_int (slog_buf &out, const conv &c, unsigned long long mag, bool neg) {
+    const unsigned int base = c.type == 'o' ? 8 : (c.type == 'x' || c.type == 'X') ? 16 : 10;
+    const bool nonzero = mag != 0;
+
+    /* the digits, the sign or "0x" may go right in front of them */
+    char digits[26];
+    char *end = digits + sizeof (digits), *p = end;
+    if (nonzero || c.prec != 0) {
+        if (base == 10) {
+            /* two digits at a time (see: slog_printf.c) */
+            while (mag >= 100) {
+                unsigned int r = static_cast<unsigned int> (mag % 100) * 2;
+                mag /= 100;
+                *--p = slog_digits2[r + 1];
+                *--p = slog_digits2[r];
+            }
+            if (mag >= 10) {
+                *--p = slog_digits2[mag * 2 + 1];
+                *--p = slog_digits2[mag * 2];
+            } else {
+                *--p = static_cast<char> ('0' + mag);
+            }
+        } else {
+            const char *xdigits = c.type == 'X' ? "0123456789ABCDEF" : "0123456789abcdef";
+            const unsigned int shift = base == 16 ? 4 : 3;
+            do {
+                *--p = xdigits[mag & (base - 1)];
+                mag >>= shift;
+            } while (mag);
+        }
+    }
+    std::size_t nd = end - p;
+
+    char prefix[2];
+    std::size_t np = 0;
+    if (c.type == 'd' || c.type == 'i') {
+        if (neg)
+            prefix[np++] = '-';
+        else if (c.flags & flag_plus)
+            prefix[np++] = '+';
+        else if (c.flags & flag_space)
+            prefix[np++] = ' ';
+    } else if ((c.flags & flag_alt) && base == 16 && nonzero) {
+        prefix[np++] = '0';
+        prefix[np++] = c.type;
+    }
+
+    std::size_t zeros = c.prec > 0 && static_cast<std::size_t> (c.prec) > nd ? c.prec - nd : 0;
+    /* "%#o" starts with a zero */
+    if ((c.flags & flag_alt) && base == 8 && !zeros && (!nd || *p != '0'))
+        zeros = 1;
+    std::size_t len = np + zeros + nd;
+    std::size_t pad = c.width > 0 && static_cast<std::size_t> (c.width) > len ? c.width - len : 0;
+    std::size_t lead = 0, trail = 0;
+    if (c.flags & flag_left)
+        trail = pad;
+    else if ((c.flags & flag_zero) && c.prec < 0)
+        zeros += pad;
+    else
+        lead = pad;
+
+    fill (out, ' ', lead);
+    if (zeros) {
+        append (out, prefix, np);
+        fill (out, '0', zeros);
+    } else {
+        p -= np;
+        std::memcpy (p, prefix, np);
+        nd += np;
+    }
+    append (out, p, nd);
+    fill (out, ' ', trail);
+}
+
+inline void put_char (slog_buf &out, const conv &c, char ch) {
+    put_padded (out, c, &ch, 1);
+}
+
+inline void put_str (slog_buf &out, const conv &c, std::string_view s) {
+    std::size_t n = c.prec >= 0 && static_cast<std::size_t> (c.prec) < s.size () ? c.prec : s.size ();
+    put_padded (out, c, s.data (), n);
+}
+
+/* floating point values are rare enough to be left to the C library */
+template <typename T>
+inline void put_float (slog_buf &out, const conv &c, T v) {
+    char spec[32];
+    std::size_t n = 0;
+    spec[n++] = '%';
+    if (c.flags & flag_left)  spec[n++] = '-';
+    if (c.flags & flag_plus)  spec[n++] = '+';
+    if (c.flags & flag_space) spec[n++] = ' ';
+    if (c.flags & flag_alt)   spec[n++] = '#';
+    if (c.flags & flag_zero)  spec[n++] = '0';
+    if (c.width > 0)
+        n += std::snprintf (spec + n, sizeof (spec) - n, "%d", c.width);
+    if (c.prec >= 0)
+        n += std::snprintf (spec + n, sizeof (spec) - n, ".%d", c.prec);
+    if constexpr (std::is_same_v<T, long double>)
+        spec[n++] = 'L';
+    spec[n++] = c.type;
+    spec[n]   = 0;
+
+    char tmp[64];
+    int w = std::snprintf (tmp, sizeof (tmp), spec, v);
+    if (w < 0)
+        return;
+    if (static_cast<std::size_t> (w) < sizeof (tmp)) {
+        append (out, tmp, w);
+        return;
+    }
+    /* a wide field is written in place */
+    std::size_t room = slog_buf_reserve (&out, w);
+    if (room)
+        std::snprintf (out.data + out.len, room + 1, spec, v);
+    out.len += w;
+}
+
+inline void put_ptr (slog_buf &out, const conv &c, const void *p) {
+    if (!p) {
+        put_padded (out, c, "(nil)", 5);
+        return;
+    }
+    conv hex = c;
+    hex.type   = 'x';
+    hex.flags |= flag_alt;
+    put_int (out, hex, reinterpret_cast<std::uintptr_t> (p), false);
+}
+
+template <typename T>
+inline void put (slog_buf &out, const conv &c, const T &v) {
+    using D = std::decay_t<T>;
+    constexpr kind k = kind_of<T> ();
+    if constexpr (std::is_enum_v<D>) {
+        put (out, c, static_cast<std::underlying_type_t<D>> (v));
+    } else if constexpr (k == kind::boolean) {
+        if (c.type == 's')
+            put_str (out, c, v ? "true" : "false");
+        else
+            put_int (out, c, v, false);
+    } else if constexpr (k == kind::character || k == kind::integer) {
+        if (c.type == 'c')
+            put_char (out, c, static_cast<char> (v));
+        else if constexpr (std::is_signed_v<D>) {
+            if (c.type == 'd' || c.type == 'i')
+                put_int (out, c, v < 0 ? 0ull - static_cast<unsigned long long> (v) : v, v < 0);
+            else
+                put_int (out, c, static_cast<std::make_unsigned_t<D>> (v), false);
+        } else {
+            put_int (out, c, v, false);
+        }
+    } else if constexpr (k == kind::floating) {
+        put_float (out, c, v);
+    } else if constexpr (k == kind::string) {
+        if constexpr (std::is_pointer_v<T>) {
+            if (!v) {
+                put_str (out, c, "(null)");
+                return;
+            }
+        }
+        put_str (out, c, std::string_view (v));
+    } else if constexpr (k == kind::pointer) {
+        put_ptr (out, c, static_cast<const void *> (v));
+    }
+}
+
+/* the message format of SLOG_STR () type S, parsed at compile time */
+template <typename S>
+struct format_of {
+    static constexpr const char *f = S::value ();
+    static constexpr std::size_t n = count (f) == bad ? 0 : count (f);
+    static constexpr parsed<n> p = parse<n> (f);
+
+    /* the argument of conversion j, "%%" takes none */
+    static constexpr std::size_t arg (std::size_t j) {
+        std::size_t k = 0;
+        for (std::size_t i = 0; i < j; ++i)
+            if (p.convs[i].type != '%')
+                ++k;
+        return k;
+    }
+};
+
+/* conversion J with the literal text before it. Every conversion is a
+ * constant here, so only the code it needs is left */
+template <typename S, std::size_t J, typename Tuple>
+inline void write_conv (slog_buf &out, const Tuple &args) {
+    using F = format_of<S>;
+    constexpr conv c = F::p.convs[J];
+    if constexpr (c.lit_len != 0)
+        append (out, F::f + c.lit_off, c.lit_len);
+    if constexpr (c.type == '%')
+        append (out, "%", 1);
+    else
+        put (out, c, std::get<F::arg (J)> (args));
+}
+
+template <typename S, typename Tuple, std::size_t... J>
+inline void render (slog_buf &out, const Tuple &args, std::index_sequence<J...>) {
+    using F = format_of<S>;
+    (write_conv<S, J> (out, args), ...);
+    if constexpr (F::p.tail_len != 0)
+        append (out, F::f + F::p.tail_off, F::p.tail_len);
+}
+
+/* write the message of a format checked by log_at () */
+template <typename S, typename... Args>
+inline void write (slog_buf &out, S fmt, const Args &...args) {
+    (void)fmt;
+    render<S> (out, std::forward_as_tuple (args...), std::make_index_sequence<format_of<S>::n> {});
+}
+
+} /* namespace detail */
+
+/* log_at - print a message with a format checked at compile time
+ * @param stream
+ *   pointer to the slog_stream structure
+ * @param site
+ *   pointer to the slog_site structure, nullptr if unknown
+ * @param level
+ *   log level of the message
+ * @param fmt
+ *   the format, SLOG_STR ("...")
+ * @param args
+ *   arguments of the format */
+template <typename S, typename... Args>
+inline void log_at (slog_stream *stream, slog_site *site, const slog_loglevel *level,
+        S fmt, const Args &...args) {
+    (void)fmt;
+    constexpr const char *f = S::value ();
+    constexpr std::size_t n = detail::count (f);
+    static_assert (n != detail::bad, "slog: malformed conversion in the message format");
+    static_assert (detail::check<Args...> (f), "slog: the arguments do not match the message format");
+
+    if constexpr (n != detail::bad && detail::check<Args...> (f)) {
+        if (!slog_enabled (stream, level))
+            return;
+
+        /* the message is written straight into the entry */
+        const std::tuple<const Args &...> ctx (args...);
+        slog_render_at (stream, site, level, [] (slog_buf *out, const void *p) {
+            detail::render<S> (*out, *static_cast<const std::tuple<const Args &...> *> (p),
+                    std::make_index_sequence<detail::format_of<S>::n> {});
+        }, &ctx);
+    }
+}
+
+template <typename S, typename... Args>
+inline void log (slog_stream *stream, const slog_loglevel *level, S fmt, const Args &...args) {
+    log_at (stream, nullptr, level, fmt, args...);
+}
+template <typename S, typename... Args>
+inline void message (slog_stream *stream, S fmt, const Args &...args) {
+    log_at (stream, nullptr, slog_loglevel_message, fmt, args...);
+}
+template <typename S, typename... Args>
+inline void warning (slog_stream *stream, S fmt, const Args &...args) {
+    log_at (stream, nullptr, slog_loglevel_warning, fmt, args...);
+}
+template <typename S, typename... Args>
+inline void error (slog_stream *stream, S fmt, const Args &...args) {
+    log_at (stream, nullptr, slog_loglevel_error, fmt, args...);
+}
+template <typename S, typename... Args>
+inline void debug (slog_stream *stream, S fmt, const Args &...args) {
+    log_at (stream, nullptr, slog_loglevel_debug, fmt, args...);
+}
+
+/* format - set the layout of a stream, checked at compile time (see: slog_format ())
+ * @param layout
+ *   the layout, SLOG_STR ("...")
+ * @return
+ *   0 on success, non-zero otherwise */
+template <typename S>
+inline char format (slog_stream *stream, S layout) {
+    (void)layout;
+    static_assert (detail::check_layout (S::value ()), "slog: unknown token in the layout");
+    return slog_format (stream, S::value ());
+}
+
+} /* namespace slog */
+
+/* a string literal as a type, so that it can be checked at compile time */
+#define SLOG_STR(s) ([] {\
+    struct __slog_str {\
+        static constexpr const char *value () { return s; }\
+    };\
+    return __slog_str {};\
+} ())
+
+/* log from a call site (see: SLOG_SITE), the arguments are not evaluated
+ * if the level is suppressed */
+#define SLOG_LOG(stream, level, fmt, ...) do {\
+    if (slog_enabled (stream, level)) {\
+        static slog_site __slog_here = SLOG_SITE;\
+        ::slog::log_at ((stream), &__slog_here, (level), SLOG_STR (fmt), ##__VA_ARGS__);\
+    }\
+} while (0)
+
+#endif
@@ -0,0 +1,43 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+#ifndef __SLOG_ALLOC_H__
+#define __SLOG_ALLOC_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "slog_export.h"
+
+/* slog_allocator - the memory functions used by slog, e.g. to keep its
+ * memory in an arena of its own. The functions have the semantics of
+ * malloc (), realloc () and free (), and must be thread-safe */
+typedef struct slog_allocator {
+    void *(*alloc) (void *ctx, size_t size);
+    void *(*realloc) (void *ctx, void *p, size_t size);
+    void  (*free) (void *ctx, void *p);
+    /* passed to the functions */
+    void *ctx;
+} slog_allocator;
+
+/* slog_set_allocator - set the global allocator. It serves the streams
+ * created without an allocator of their own, the per-thread buffers and
+ * the temporary allocations
+ * @param alloc
+ *   the allocator (copied), NULL for malloc () and free ()
+ * @note
+ *   must be called before any other slog function, the memory is never
+ *   handed from one allocator to another */
+SLOG_API void slog_set_allocator (const slog_allocator *alloc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,347 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+/* The ring is a bounded queue in the style of D. Vyukov: every cell
+ * carries a sequence number, which tells whether the cell is free for
+ * the producer owning position `pos` (seq == pos) or holds an entry
+ * for the consumer (seq == pos + 1). Producers claim positions with a
+ * single CAS on `head`, the only consumer is the writer thread. It takes
+ * the entries with a CAS on `tail`, so that a producer finding the ring
+ * full can take the oldest entry away from it (_ring_evict ()), and copies
+ * each entry out of its cell before writing it. */
+
+#include "slog_async.h"
+#include "slog_log.h"
+#include "slog_mem.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#define SLOG_CACHELINE 64
+
+struct slog_ring_cell {
+    atomic_size_t seq;
+    const slog_loglevel *level;
+    unsigned int dst;
+    size_t len;
+    /* pushed as slog_ring_keep, read by _ring_evict () before it claims
+     * the cell, so it must not tear */
+    atomic_uchar keep;
+    /* heap copy of an entry, which does not fit into data */
+    char *ext;
+    char data[SLOG_RING_SLOTSIZ];
+};
+
+struct slog_ring {
+    struct slog_ring_cell *cells;
+    size_t mask;
+
+    slog_ring_writer writer;
+    void *ctx;
+    const slog_allocator *alloc;
+
+    /* next position to be claimed by a producer */
+    _Alignas (SLOG_CACHELINE) atomic_size_t head;
+    /* next position to be consumed by the writer thread or evicted */
+    _Alignas (SLOG_CACHELINE) atomic_size_t tail;
+    /* the positions below are written out or evicted (see: slog_ring_drain ()) */
+    atomic_size_t done;
+
+    /* entries dropped by a full ring, by the index of their level */
+    atomic_ullong dropped[SLOG_LEVELS_MAX];
+    /* dropped since the last slog_ring_take_dropped () */
+    atomic_ullong unreported;
+
+    /* set while the writer thread waits for new entries */
+    _Alignas (SLOG_CACHELINE) atomic_int sleeping;
+    /* number of threads waiting in slog_ring_drain () */
+    atomic_int draining;
+    atomic_int stop;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;
+    pthread_cond_t  drained;
+    pthread_t thread;
+};
+
+static void _ring_wake (slog_ring *ring) {
+    pthread_mutex_lock (&ring->lock);
+    pthread_cond_signal (&ring->wake);
+    pthread_mutex_unlock (&ring->lock);
+}
+
+/* is there an entry at the position `tail` */
+static int _ring_ready (slog_ring *ring, size_t tail) {
+    struct slog_ring_cell *cell = &ring->cells[tail & ring->mask];
+    return atomic_load_explicit (&cell->seq, memory_order_acquire) == tail + 1;
+}
+
+static void _ring_count_dropped (slog_ring *ring, const slog_loglevel *level) {
+    atomic_fetch_add_explicit (&ring->dropped[level ? level->index : 0], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit (&ring->unreported, 1, memory_order_relaxed);
+}
+
+/* take the entry at the position `tail` from the writer thread,
+ * returns 0 if it was not there or somebody else was faster */
+static int _ring_claim (slog_ring *ring, size_t tail) {
+    return _ring_ready (ring, tail)
+        && atomic_compare_exchange_strong_explicit (&ring->tail, &tail, tail + 1,
+                memory_order_relaxed, memory_order_relaxed);
+}
+
+/* announce the entries written out or evicted so far */
+static void _ring_done (slog_ring *ring) {
+    size_t tail = atomic_load (&ring->tail);
+    if (atomic_load_explicit (&ring->done, memory_order_relaxed) == tail)
+        return;
+    atomic_store (&ring->done, tail);
+    if (atomic_load (&ring->draining)) {
+        pthread_mutex_lock (&ring->lock);
+        pthread_cond_broadcast (&ring->drained);
+        pthread_mutex_unlock (&ring->lock);
+    }
+}
+
+static void *_ring_thread (void *arg) {
+    slog_ring *ring = arg;
+    char data[SLOG_RING_SLOTSIZ];
+    size_t tail;
+
+    for (;;) {
+        size_t batch = 0;
+        for (;;) {
+            tail = atomic_load_explicit (&ring->tail, memory_order_relaxed);
+            if (!_ring_ready (ring, tail))
+                break;
+            if (!_ring_claim (ring, tail))
+                continue;
+            struct slog_ring_cell *cell = &ring->cells[tail & ring->mask];
+            const slog_loglevel *level = cell->level;
+            unsigned int dst = cell->dst;
+            size_t len = cell->len;
+            char *ext = cell->ext;
+            cell->ext = NULL;
+            if (!ext)
+                memcpy (data, cell->data, len);
+
+            /* hand the cell back to the producer of the next lap before
+             * the I/O, a full ring never waits for the entry being written
+             * (the oldest one can always be evicted) */
+            atomic_store_explicit (&cell->seq, tail + ring->mask + 1, memory_order_release);
+
+            ring->writer (ring->ctx, level, dst, ext ? ext : data, len);
+            if (ext)
+                slog_mem_free (ring->alloc, ext);
+            ++batch;
+        }
+
+        if (batch)
+            ring->writer (ring->ctx, NULL, 0, NULL, 0);
+        _ring_done (ring);
+
+        pthread_mutex_lock (&ring->lock);
+        atomic_store (&ring->sleeping, 1);
+        atomic_thread_fence (memory_order_seq_cst);
+        /* re-check after announcing the sleep, a producer which published
+         * its entry before seeing `sleeping` would not wake us up */
+        if (!_ring_ready (ring, atomic_load (&ring->tail))) {
+            if (atomic_load (&ring->stop)) {
+                atomic_store (&ring->sleeping, 0);
+                pthread_mutex_unlock (&ring->lock);
+                break;
+            }
+            pthread_cond_wait (&ring->wake, &ring->lock);
+        }
+        atomic_store (&ring->sleeping, 0);
+        pthread_mutex_unlock (&ring->lock);
+    }
+    return NULL;
+}
+
+slog_ring *slog_ring_create (size_t capacity, const slog_allocator *alloc,
+        slog_ring_writer writer, void *ctx) {
+    assert (writer != NULL);
+
+    size_t n = 2, i;
+    while (n < capacity)
+        n <<= 1;
+
+    slog_ring *ring = slog_mem_alloc (alloc, sizeof (slog_ring));
+    if (!ring)
+        return NULL;
+    ring->cells = slog_mem_alloc (alloc, n * sizeof (struct slog_ring_cell));
+    if (!ring->cells) {
+        slog_mem_free (alloc, ring);
+        return NULL;
+    }
+    ring->alloc  = alloc;
+    for (i = 0; i < n; ++i) {
+        atomic_init (&ring->cells[i].seq, i);
+        atomic_init (&ring->cells[i].keep, 0);
+        ring->cells[i].ext = NULL;
+    }
+    ring->mask   = n - 1;
+    ring->writer = writer;
+    ring->ctx    = ctx;
+    atomic_init (&ring->head, 0);
+    atomic_init (&ring->tail, 0);
+    atomic_init (&ring->done, 0);
+    for (i = 0; i < SLOG_LEVELS_MAX; ++i)
+        atomic_init (&ring->dropped[i], 0);
+    atomic_init (&ring->unreported, 0);
+    atomic_init (&ring->sleeping, 0);
+    atomic_init (&ring->draining, 0);
+    atomic_init (&ring->stop, 0);
+
+    pthread_mutex_init (&ring->lock, NULL);
+    pthread_cond_init (&ring->wake, NULL);
+    pthread_cond_init (&ring->drained, NULL);
+
+    if (pthread_create (&ring->thread, NULL, _ring_thread, ring) != 0) {
+        slog_log_error ("Failed to start the writer thread");
+        pthread_mutex_destroy (&ring->lock);
+        pthread_cond_destroy (&ring->wake);
+        pthread_cond_destroy (&ring->drained);
+        slog_mem_free (alloc, ring->cells);
+        slog_mem_free (alloc, ring);
+        return NULL;
+    }
+    return ring;
+}
+
+/* drop the oldest entry to make room, returns 0 if it could not be taken
+ * or must not be dropped. A stale `keep` of a cell, which the writer took
+ * meanwhile, does not matter: the CAS on `tail` fails then */
+static int _ring_evict (slog_ring *ring) {
+    size_t tail = atomic_load_explicit (&ring->tail, memory_order_relaxed);
+    struct slog_ring_cell *cell = &ring->cells[tail & ring->mask];
+    if (!_ring_ready (ring, tail)
+            || atomic_load_explicit (&cell->keep, memory_order_relaxed)
+            || !_ring_claim (ring, tail))
+        return 0;
+
+    _ring_count_dropped (ring, cell->level);
+    if (cell->ext) {
+        slog_mem_free (ring->alloc, cell->ext);
+        cell->ext = NULL;
+    }
+    atomic_store_explicit (&cell->seq, tail + ring->mask + 1, memory_order_release);
+    return 1;
+}
+
+char slog_ring_push (slog_ring *ring, const slog_loglevel *level, unsigned int dst,
+        const char *entry, size_t len, slog_ring_full full) {
+    assert (ring != NULL);
+
+    struct slog_ring_cell *cell;
+    size_t pos = atomic_load_explicit (&ring->head, memory_order_relaxed);
+    for (;;) {
+        cell = &ring->cells[pos & ring->mask];
+        size_t seq = atomic_load_explicit (&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit (&ring->head, &pos, pos + 1,
+                        memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            if (full == slog_ring_drop) {
+                _ring_count_dropped (ring, level);
+                return 1;
+            }
+            /* the ring is full, let the writer catch up. An evicted
+             * entry is lost for good, the writer may be stuck on I/O,
+             * but it does not hold a cell meanwhile. A kept entry at
+             * the tail makes the evicting producers wait as well */
+            if (full != slog_ring_evict || !_ring_evict (ring)) {
+                if (atomic_load (&ring->sleeping))
+                    _ring_wake (ring);
+                sched_yield ();
+            }
+            pos = atomic_load_explicit (&ring->head, memory_order_relaxed);
+        } else {
+            pos = atomic_load_explicit (&ring->head, memory_order_relaxed);
+        }
+    }
+
+    cell->level = level;
+    cell->dst   = dst;
+    cell->len   = len;
+    atomic_store_explicit (&cell->keep, full == slog_ring_keep, memory_order_relaxed);
+    if (len > SLOG_RING_SLOTSIZ) {
+        cell->ext = slog_mem_alloc (ring->alloc, len);
+        if (cell->ext)
+            memcpy (cell->ext, entry, len);
+        else
+            cell->len = 0;
+    } else {
+        memcpy (cell->data, entry, len);
+    }
+    atomic_store_explicit (&cell->seq, pos + 1, memory_order_release);
+
+    atomic_thread_fence (memory_order_seq_cst);
+    if (atomic_load_explicit (&ring->sleeping, memory_order_relaxed))
+        _ring_wake (ring);
+    return 0;
+}
+
+void slog_ring_drain (slog_ring *ring) {
+    assert (ring != NULL);
+
+    size_t target = atomic_load (&ring->head);
+    if (atomic_load (&ring->done) >= target)
+        return;
+
+    atomic_fetch_add (&ring->draining, 1);
+    pthread_mutex_lock (&ring->lock);
+    while (atomic_load (&ring->done) < target) {
+        pthread_cond_signal (&ring->wake);
+        pthread_cond_wait (&ring->drained, &ring->lock);
+    }
+    pthread_mutex_unlock (&ring->lock);
+    atomic_fetch_sub (&ring->draining, 1);
+}
+
+unsigned long long slog_ring_dropped (slog_ring *ring, unsigned int index) {
+    assert (ring != NULL);
+
+    if (index >= SLOG_LEVELS_MAX)
+        return 0;
+    return atomic_load_explicit (&ring->dropped[index], memory_order_relaxed);
+}
+
+unsigned long long slog_ring_take_dropped (slog_ring *ring) {
+    assert (ring != NULL);
+
+    if (!atomic_load_explicit (&ring->unreported, memory_order_relaxed))
+        return 0;
+    return atomic_exchange_explicit (&ring->unreported, 0, memory_order_relaxed);
+}
+
+int slog_ring_is_writer (slog_ring *ring) {
+    return pthread_equal (pthread_self (), ring->thread);
+}
+
+void slog_ring_destroy (slog_ring *ring) {
+    assert (ring != NULL);
+
+    pthread_mutex_lock (&ring->lock);
+    atomic_store (&ring->stop, 1);
+    pthread_cond_signal (&ring->wake);
+    pthread_mutex_unlock (&ring->lock);
+    pthread_join (ring->thread, NULL);
+
+    pthread_mutex_destroy (&ring->lock);
+    pthread_cond_destroy (&ring->wake);
+    pthread_cond_destroy (&ring->drained);
+    const slog_allocator *alloc = ring->alloc;
+    slog_mem_free (alloc, ring->cells);
+    slog_mem_free (alloc, ring);
+}
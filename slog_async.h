@@ -0,0 +1,102 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+#ifndef __SLOG_ASYNC_H__
+#define __SLOG_ASYNC_H__
+
+#include "slog_alloc.h"
+#include "slog_export.h"
+#include "slog_loglevel.h"
+#include <stddef.h>
+
+/* Entries up to this size are stored inline in the ring, longer
+ * ones are copied to the heap by the producer */
+#define SLOG_RING_SLOTSIZ 256
+
+/* a bounded multi-producer single-consumer queue of log entries,
+ * drained by a dedicated writer thread */
+typedef struct slog_ring slog_ring;
+
+/* what slog_ring_push () does when the ring is full */
+typedef enum slog_ring_full {
+    /* wait for the writer thread */
+    slog_ring_wait,
+    /* drop the entry being pushed */
+    slog_ring_drop,
+    /* drop the oldest entry in the ring */
+    slog_ring_evict,
+    /* wait for the writer thread, the entry is never evicted either */
+    slog_ring_keep
+} slog_ring_full;
+
+/* slog_ring_writer - callback invoked on the writer thread
+ * @param ctx
+ *   user pointer passed to slog_ring_create ()
+ * @param level
+ *   log level of the entry
+ * @param dst
+ *   destinations of the entry, as passed to slog_ring_push ()
+ * @param entry
+ *   formatted entry (not NUL-terminated), NULL after each batch,
+ *   so that the callee can flush its outputs
+ * @param len
+ *   length of the entry */
+typedef void (*slog_ring_writer) (void *ctx, const slog_loglevel *level, unsigned int dst,
+        const char *entry, size_t len);
+
+/* slog_ring_create - create a ring and start its writer thread
+ * @param capacity
+ *   number of entries, rounded up to a power of 2
+ * @param alloc
+ *   allocator of the ring and of the long entries, it must outlive
+ *   the ring, NULL for the global one
+ * @param writer
+ *   callback, which performs the actual output
+ * @param ctx
+ *   user pointer for the callback
+ * @return
+ *   valid pointer to slog_ring on success, otherwise NULL */
+SLOG_API slog_ring *slog_ring_create (size_t capacity, const slog_allocator *alloc,
+        slog_ring_writer writer, void *ctx);
+/* slog_ring_push - copy an entry into the ring
+ * @param ring
+ *   pointer to the slog_ring structure
+ * @param level
+ *   log level of the entry
+ * @param dst
+ *   destinations of the entry, opaque to the ring
+ * @param entry
+ *   formatted entry
+ * @param len
+ *   length of the entry
+ * @param full
+ *   what to do if the ring is full
+ * @return
+ *   0 if the entry was queued, 1 if it was dropped */
+SLOG_API char slog_ring_push (slog_ring *ring, const slog_loglevel *level, unsigned int dst,
+        const char *entry, size_t len, slog_ring_full full);
+/* slog_ring_drain - wait until every entry pushed before the call
+ * has been handed to the writer callback
+ * @param ring
+ *   pointer to the slog_ring structure */
+SLOG_API void slog_ring_drain (slog_ring *ring);
+/* slog_ring_dropped - get the number of entries of a level dropped
+ * by the ring so far
+ * @param index
+ *   index of the level (see: slog_loglevel.index) */
+SLOG_API unsigned long long slog_ring_dropped (slog_ring *ring, unsigned int index);
+/* slog_ring_take_dropped - get the number of entries dropped since the
+ * previous call and start counting anew */
+SLOG_API unsigned long long slog_ring_take_dropped (slog_ring *ring);
+/* slog_ring_is_writer - check whether the calling thread is the writer
+ * thread of the ring */
+SLOG_API int slog_ring_is_writer (slog_ring *ring);
+/* slog_ring_destroy - drain the ring, stop the writer thread and free the ring
+ * @param ring
+ *   pointer to the slog_ring structure */
+SLOG_API void slog_ring_destroy (slog_ring *ring);
+
+#endif
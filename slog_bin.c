@@ -0,0 +1,363 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+#include "slog_bin.h"
+#include "slog_clock.h"
+#include "slog_mem.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/* Lookups are lock-free: a slot is claimed under the lock, the dictionary
+ * record is emitted and only then the id is published, so an entry can
+ * never be written before the record it refers to. */
+struct slog_bin_slot {
+    _Atomic (const void *) key;
+    /* 0 until the dictionary record has been emitted */
+    atomic_uint id;
+};
+
+struct slog_bin {
+    const slog_allocator *alloc;
+    pthread_mutex_t lock;
+    unsigned int last_id;
+    struct slog_bin_slot slots[SLOG_BIN_DICTSIZ];
+};
+
+const char *slog_bin_next (const char *p, slog_bin_spec *spec) {
+    assert (spec != NULL);
+
+    const char *s = strchr (p, '%');
+    if (!s)
+        return NULL;
+
+    const char *q = s + 1;
+    size_t n = 0;
+
+    memset (spec, 0, sizeof (slog_bin_spec));
+    spec->start = s;
+    spec->width = spec->prec = -1;
+    spec->arg   = slog_bin_arg_unsupported;
+
+    while (*q && strchr ("-+ #0'", *q)) {
+        if (n < sizeof (spec->flags) - 1)
+            spec->flags[n++] = *q;
+        ++q;
+    }
+
+    if (*q == '*') {
+        spec->star_width = 1;
+        ++q;
+    } else if (*q >= '0' && *q <= '9') {
+        spec->width = 0;
+        while (*q >= '0' && *q <= '9')
+            spec->width = spec->width * 10 + (*q++ - '0');
+        /* positional arguments */
+        if (*q == '$')
+            goto done;
+    }
+
+    if (*q == '.') {
+        ++q;
+        spec->prec = 0;
+        if (*q == '*') {
+            spec->star_prec = 1;
+            ++q;
+        } else {
+            while (*q >= '0' && *q <= '9')
+                spec->prec = spec->prec * 10 + (*q++ - '0');
+        }
+    }
+
+    n = 0;
+    while (*q && strchr ("hljztLq", *q) && n < sizeof (spec->length) - 1)
+        spec->length[n++] = *q++;
+
+    spec->conv = *q;
+    if (!*q)
+        goto done;
+    ++q;
+
+#define is_len(x) (strcmp (spec->length, x) == 0)
+    switch (spec->conv) {
+        case '%':
+            spec->arg = slog_bin_arg_none;
+            break;
+        case 'd': case 'i':
+        case 'u': case 'o': case 'x': case 'X':
+            if (is_len ("") || is_len ("h") || is_len ("hh"))
+                spec->arg = slog_bin_arg_int;
+            else if (is_len ("l"))
+                spec->arg = slog_bin_arg_long;
+            else if (is_len ("ll") || is_len ("q"))
+                spec->arg = slog_bin_arg_llong;
+            else if (is_len ("j"))
+                spec->arg = slog_bin_arg_intmax;
+            else if (is_len ("z"))
+                spec->arg = slog_bin_arg_size;
+            else if (is_len ("t"))
+                spec->arg = slog_bin_arg_ptrdiff;
+            break;
+        case 'c':
+            if (is_len (""))
+                spec->arg = slog_bin_arg_int;
+            break;
+        case 's':
+            if (is_len (""))
+                spec->arg = slog_bin_arg_str;
+            break;
+        case 'p':
+            spec->arg = slog_bin_arg_ptr;
+            break;
+        case 'f': case 'F': case 'e': case 'E':
+        case 'g': case 'G': case 'a': case 'A':
+            if (is_len ("L"))
+                spec->arg = slog_bin_arg_ldouble;
+            else if (is_len ("") || is_len ("l"))
+                spec->arg = slog_bin_arg_double;
+            break;
+        default:
+            break;
+    }
+#undef is_len
+
+done:
+    spec->len = q - s;
+    return q;
+}
+
+slog_bin *slog_bin_create (const slog_allocator *alloc) {
+    slog_bin *bin = slog_mem_alloc (alloc, sizeof (slog_bin));
+    if (!bin)
+        return NULL;
+    bin->alloc = alloc;
+
+    size_t i;
+    for (i = 0; i < SLOG_BIN_DICTSIZ; ++i) {
+        atomic_init (&bin->slots[i].key, NULL);
+        atomic_init (&bin->slots[i].id, 0);
+    }
+    bin->last_id = 0;
+    pthread_mutex_init (&bin->lock, NULL);
+    return bin;
+}
+
+void slog_bin_destroy (slog_bin *bin) {
+    assert (bin != NULL);
+    pthread_mutex_destroy (&bin->lock);
+    slog_mem_free (bin->alloc, bin);
+}
+
+static void _put (slog_buf *out, const void *p, size_t n) {
+    slog_buf_append (out, p, n);
+}
+static void _put_u32 (slog_buf *out, uint32_t v) {
+    _put (out, &v, sizeof (v));
+}
+static void _put_type (slog_buf *out, slog_bin_record type) {
+    char c = (char)type;
+    _put (out, &c, 1);
+}
+static void _put_time (slog_buf *out) {
+    struct timespec ts;
+    slog_clock_now (&ts);
+
+    int64_t sec = ts.tv_sec;
+    _put (out, &sec, sizeof (sec));
+    _put_u32 (out, (uint32_t)ts.tv_nsec);
+}
+
+void slog_bin_layout (slog_buf *out, const char *layout) {
+    uint32_t len = strlen (layout);
+    _put_type (out, slog_bin_rec_layout);
+    _put_u32 (out, len);
+    _put (out, layout, len);
+}
+
+void slog_bin_session (slog_buf *out, const char *layout) {
+    _put_type (out, slog_bin_rec_session);
+    _put (out, SLOG_BIN_MAGIC, 8);
+    slog_bin_layout (out, layout);
+}
+
+/* get the dictionary id of a format or a level, 0 if the dictionary is full */
+static unsigned int _bin_lookup (slog_bin *bin, const void *key, slog_bin_record type,
+        const char *str, slog_bin_emit emit, void *ctx) {
+    size_t h = (((uintptr_t)key >> 3) * 0x9e3779b97f4a7c15ull) >> 32, i;
+
+    for (i = 0; i < SLOG_BIN_DICTSIZ; ++i) {
+        struct slog_bin_slot *slot = &bin->slots[(h + i) & (SLOG_BIN_DICTSIZ - 1)];
+        const void *k = atomic_load_explicit (&slot->key, memory_order_acquire);
+
+        if (k == key) {
+            unsigned int id = atomic_load_explicit (&slot->id, memory_order_acquire);
+            if (!id) {
+                /* being inserted right now, the inserter holds the lock */
+                pthread_mutex_lock (&bin->lock);
+                id = atomic_load_explicit (&slot->id, memory_order_acquire);
+                pthread_mutex_unlock (&bin->lock);
+            }
+            return id;
+        }
+        if (k)
+            continue;
+
+        pthread_mutex_lock (&bin->lock);
+        k = atomic_load_explicit (&slot->key, memory_order_acquire);
+        if (k) {
+            unsigned int id = k == key ? atomic_load (&slot->id) : 0;
+            pthread_mutex_unlock (&bin->lock);
+            if (id)
+                return id;
+            continue;
+        }
+        atomic_store_explicit (&slot->key, key, memory_order_release);
+
+        unsigned int id = ++bin->last_id;
+        uint32_t len = strlen (str);
+        slog_buf rec;
+        if (slog_buf_init (&rec, NULL, len + 16) == 0) {
+            _put_type (&rec, type);
+            _put_u32 (&rec, id);
+            _put_u32 (&rec, len);
+            _put (&rec, str, len);
+            if (!rec.failed)
+                emit (ctx, rec.data, rec.len);
+            slog_free (rec.data);
+        }
+
+        atomic_store_explicit (&slot->id, id, memory_order_release);
+        pthread_mutex_unlock (&bin->lock);
+        return id;
+    }
+    return 0;
+}
+
+/* append the arguments of fmt, non-zero if a conversion cannot be deferred */
+static char _bin_args (slog_buf *out, const char *fmt, va_list *list) {
+    slog_bin_spec spec;
+    const char *p = fmt;
+
+    while ((p = slog_bin_next (p, &spec)) != NULL) {
+        int prec = spec.prec;
+        if (spec.arg == slog_bin_arg_unsupported)
+            return 1;
+
+        if (spec.star_width) {
+            int v = va_arg (*list, int);
+            _put (out, &v, sizeof (v));
+        }
+        if (spec.star_prec) {
+            prec = va_arg (*list, int);
+            _put (out, &prec, sizeof (prec));
+        }
+
+#define put_arg(type) {\
+    type v = va_arg (*list, type);\
+    _put (out, &v, sizeof (v));\
+    break;\
+}
+        switch (spec.arg) {
+            case slog_bin_arg_none:
+                break;
+            case slog_bin_arg_int:     put_arg (int)
+            case slog_bin_arg_long:    put_arg (long)
+            case slog_bin_arg_llong:   put_arg (long long)
+            case slog_bin_arg_intmax:  put_arg (intmax_t)
+            case slog_bin_arg_size:    put_arg (size_t)
+            case slog_bin_arg_ptrdiff: put_arg (ptrdiff_t)
+            case slog_bin_arg_double:  put_arg (double)
+            case slog_bin_arg_ldouble: put_arg (long double)
+            case slog_bin_arg_ptr:     put_arg (void *)
+            case slog_bin_arg_str: {
+                const char *s = va_arg (*list, const char *);
+                if (!s) {
+                    _put_u32 (out, SLOG_BIN_NULLSTR);
+                    break;
+                }
+                /* with a precision the string need not be terminated */
+                uint32_t len = prec >= 0 ? strnlen (s, prec) : strlen (s);
+                _put_u32 (out, len);
+                _put (out, s, len);
+                break;
+            }
+            default:
+                return 1;
+        }
+#undef put_arg
+    }
+    return 0;
+}
+
+/* append a 'T' record, the message is formatted right away */
+static char _bin_text (slog_buf *out, unsigned int level_id, const char *fmt, va_list *list) {
+    _put_type (out, slog_bin_rec_text);
+    _put_u32 (out, level_id);
+    _put_time (out);
+
+    /* the length is patched, once the message is written */
+    size_t len_off = out->len;
+    _put_u32 (out, 0);
+    size_t msg_off = out->len;
+    if (list)
+        slog_buf_vprintf (out, fmt, list);
+    else
+        _put (out, fmt, strlen (fmt));
+    if (out->failed)
+        return 1;
+
+    uint32_t len = out->len - msg_off;
+    memcpy (&out->data[len_off], &len, sizeof (len));
+    return 0;
+}
+
+char slog_bin_vprintf (slog_bin *bin, slog_buf *out, const slog_loglevel *level,
+        const char *fmt, va_list *list, slog_bin_emit emit, void *ctx) {
+    assert (bin != NULL);
+
+    unsigned int level_id = _bin_lookup (bin, level, slog_bin_rec_level, level->prefix, emit, ctx),
+                 fmt_id   = _bin_lookup (bin, fmt, slog_bin_rec_format, fmt, emit, ctx);
+
+    size_t start = out->len;
+    if (fmt_id && level_id) {
+        _put_type (out, slog_bin_rec_entry);
+        _put_u32 (out, fmt_id);
+        _put_u32 (out, level_id);
+        _put_time (out);
+
+        size_t len_off = out->len;
+        _put_u32 (out, 0);
+        size_t args_off = out->len;
+
+        va_list vac;
+        va_copy (vac, *list);
+        char deferred = _bin_args (out, fmt, &vac) == 0;
+        va_end (vac);
+
+        if (deferred && !out->failed) {
+            uint32_t len = out->len - args_off;
+            memcpy (&out->data[len_off], &len, sizeof (len));
+            return 0;
+        }
+        /* start over with a text record */
+        out->len = start;
+        out->failed = 0;
+    }
+    return _bin_text (out, level_id, fmt, list);
+}
+
+char slog_bin_puts (slog_bin *bin, slog_buf *out, const slog_loglevel *level,
+        const char *message, slog_bin_emit emit, void *ctx) {
+    assert (bin != NULL);
+
+    unsigned int level_id = _bin_lookup (bin, level, slog_bin_rec_level, level->prefix, emit, ctx);
+    return _bin_text (out, level_id, message, NULL);
+}
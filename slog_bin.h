@@ -0,0 +1,139 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+#ifndef __SLOG_BIN_H__
+#define __SLOG_BIN_H__
+
+/* Binary (deferred) logging: instead of running vsnprintf () the
+ * stream records the message format, the level, a timestamp and the raw
+ * argument bytes. The text is produced offline by slog-decode.
+ *
+ * The file is a sequence of records, each one starts with its type byte,
+ * all numbers are stored in the native byte order:
+ *   'S' magic[8]                            - start of a session,
+ *                                             the dictionaries are reset
+ *   'L' u32 len, layout[len]                - slog_fmt layout of the stream
+ *   'F' u32 id, u32 len, format[len]        - message format dictionary
+ *   'V' u32 id, u32 len, prefix[len]        - log level dictionary
+ *   'E' u32 format, u32 level, i64 sec, u32 nsec, u32 len, args[len]
+ *                                           - an entry
+ *   'T' u32 level, i64 sec, u32 nsec, u32 len, message[len]
+ *                                           - an entry, which was formatted
+ *                                             right away (see below)
+ * Integer and floating point arguments (and '*' widths) are stored with
+ * the size of their C type, strings as u32 len followed by the bytes
+ * (len 0xffffffff for NULL). Messages with conversions, which cannot be
+ * deferred (%n, %m, wide characters, positional arguments) are formatted
+ * right away and written as 'T' records. */
+
+#include "slog_alloc.h"
+#include "slog_export.h"
+#include "slog_buf.h"
+#include "slog_loglevel.h"
+#include <stdarg.h>
+
+#define SLOG_BIN_MAGIC "SLOGBIN1"
+/* the number of distinct formats and levels a binary stream can remember,
+ * entries with other formats are written as 'T' records */
+#define SLOG_BIN_DICTSIZ 4096
+#define SLOG_BIN_NULLSTR 0xffffffffu
+
+typedef enum slog_bin_record {
+    slog_bin_rec_session = 'S',
+    slog_bin_rec_layout  = 'L',
+    slog_bin_rec_format  = 'F',
+    slog_bin_rec_level   = 'V',
+    slog_bin_rec_entry   = 'E',
+    slog_bin_rec_text    = 'T'
+} slog_bin_record;
+
+/* how an argument of a conversion is stored */
+typedef enum slog_bin_arg {
+    /* %% */
+    slog_bin_arg_none,
+    slog_bin_arg_int,
+    slog_bin_arg_long,
+    slog_bin_arg_llong,
+    slog_bin_arg_intmax,
+    slog_bin_arg_size,
+    slog_bin_arg_ptrdiff,
+    slog_bin_arg_double,
+    slog_bin_arg_ldouble,
+    slog_bin_arg_str,
+    slog_bin_arg_ptr,
+    slog_bin_arg_unsupported
+} slog_bin_arg;
+
+/* a printf () conversion */
+typedef struct slog_bin_spec {
+    /* the conversion text, starting at '%' */
+    const char *start;
+    size_t len;
+    slog_bin_arg arg;
+    char flags[8];
+    /* -1 if not given */
+    int width,
+        prec;
+    /* the width/precision is an argument ('*') */
+    unsigned char star_width,
+                  star_prec;
+    char length[3];
+    char conv;
+} slog_bin_spec;
+
+/* dictionary of the formats and levels of a binary stream */
+typedef struct slog_bin slog_bin;
+
+/* slog_bin_emit - callback, which writes a dictionary record to the stream
+ * before the entry referring to it */
+typedef void (*slog_bin_emit) (void *ctx, const char *record, size_t len);
+
+/* slog_bin_next - find the next conversion of a printf () format
+ * @param p
+ *   the format
+ * @param spec
+ *   buffer, where the conversion is parsed to
+ * @return
+ *   pointer past the conversion, NULL if there are no more conversions */
+SLOG_API const char *slog_bin_next (const char *p, slog_bin_spec *spec);
+
+/* slog_bin_create - create a dictionary
+ * @param alloc
+ *   allocator of the dictionary, it must outlive it, NULL for the global one */
+SLOG_API slog_bin *slog_bin_create (const slog_allocator *alloc);
+SLOG_API void slog_bin_destroy (slog_bin *bin);
+
+/* slog_bin_session - append a session record followed by a layout record */
+SLOG_API void slog_bin_session (slog_buf *out, const char *layout);
+/* slog_bin_layout - append a layout record */
+SLOG_API void slog_bin_layout (slog_buf *out, const char *layout);
+
+/* slog_bin_vprintf - append an entry record
+ * @param bin
+ *   dictionary of the stream
+ * @param out
+ *   output buffer
+ * @param level
+ *   log level of the entry
+ * @param fmt
+ *   message format, its address identifies it in the dictionary, so it
+ *   should be a string literal
+ * @param list
+ *   arguments for fmt
+ * @param emit
+ *   callback for the new dictionary records
+ * @param ctx
+ *   user pointer for the callback
+ * @return
+ *   0 on success, non-zero otherwise */
+SLOG_API char slog_bin_vprintf (slog_bin *bin, slog_buf *out, const slog_loglevel *level,
+        const char *fmt, va_list *list, slog_bin_emit emit, void *ctx);
+/* slog_bin_puts - append a 'T' entry record for a plain message
+ * (see: slog_bin_vprintf ()) */
+SLOG_API char slog_bin_puts (slog_bin *bin, slog_buf *out, const slog_loglevel *level,
+        const char *message, slog_bin_emit emit, void *ctx);
+
+#endif
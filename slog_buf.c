@@ -0,0 +1,141 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+#include "slog_buf.h"
+#include "slog_mem.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+/* reallocations done by the thread, see slog_stats () */
+static _Thread_local unsigned long long slog_buf_grown_;
+
+char slog_buf_init (slog_buf *buf, char *data, size_t size) {
+    assert (buf != NULL);
+
+    buf->len    = 0;
+    buf->failed = 0;
+    if (data) {
+        buf->data  = data;
+        buf->size  = size;
+        buf->fixed = 1;
+        return 0;
+    }
+
+    buf->fixed = 0;
+    buf->size  = size ? size : SLOG_BUFSIZ;
+    buf->data  = slog_xalloc (buf->size);
+    if (!buf->data) {
+        buf->size   = 0;
+        buf->failed = 1;
+        return 1;
+    }
+    return 0;
+}
+
+size_t slog_buf_reserve (slog_buf *buf, size_t n) {
+    if (buf->len + n < buf->size)
+        return n;
+
+    if (buf->fixed || buf->failed)
+        return buf->len + 1 < buf->size ? buf->size - buf->len - 1 : 0;
+
+    /* grow geometrically, so that long entries cost O(log n) reallocations */
+    size_t size = buf->size * 2;
+    if (size < buf->len + n + 1)
+        size = buf->len + n + 1;
+
+    char *p = slog_realloc (buf->data, size);
+    if (!p) {
+        buf->failed = 1;
+        return buf->len + 1 < buf->size ? buf->size - buf->len - 1 : 0;
+    }
+    buf->data = p;
+    buf->size = size;
+    ++slog_buf_grown_;
+    return n;
+}
+
+void slog_buf_append (slog_buf *buf, const char *str, size_t n) {
+    size_t room = slog_buf_reserve (buf, n);
+    if (room)
+        memcpy (buf->data + buf->len, str, room);
+    /* for truncated output len keeps counting, as snprintf () does */
+    buf->len += n;
+}
+
+void slog_buf_terminate (slog_buf *buf) {
+    if (!buf->size)
+        return;
+    buf->data[buf->len < buf->size ? buf->len : buf->size - 1] = 0x0;
+}
+
+static pthread_key_t  slog_buf_key_;
+static pthread_once_t slog_buf_once_ = PTHREAD_ONCE_INIT;
+/* the key only serves to free the buffers at the thread exit,
+ * lookups go through the cheaper thread-local pointer */
+static _Thread_local slog_buf *slog_buf_tls_;
+
+static void _buf_thread_free (void *p) {
+    slog_buf *buf = p;
+    unsigned int i;
+    for (i = 0; i < SLOG_BUF_THREAD; ++i)
+        if (buf[i].data)
+            slog_free (buf[i].data);
+    slog_free (buf);
+}
+static void _buf_key_create (void) {
+    pthread_key_create (&slog_buf_key_, _buf_thread_free);
+}
+
+slog_buf *slog_buf_thread_at (unsigned int i) {
+    assert (i < SLOG_BUF_THREAD);
+
+    slog_buf *buf = slog_buf_tls_;
+    if (buf) {
+        buf[i].len    = 0;
+        buf[i].failed = 0;
+        return &buf[i];
+    }
+
+    pthread_once (&slog_buf_once_, _buf_key_create);
+    buf = slog_xalloc (SLOG_BUF_THREAD * sizeof (slog_buf));
+    if (!buf)
+        return NULL;
+    unsigned int j;
+    for (j = 0; j < SLOG_BUF_THREAD; ++j) {
+        if (slog_buf_init (&buf[j], NULL, SLOG_BUFSIZ) != 0) {
+            while (j--)
+                slog_free (buf[j].data);
+            slog_free (buf);
+            return NULL;
+        }
+    }
+    pthread_setspecific (slog_buf_key_, buf);
+    slog_buf_tls_ = buf;
+    return &buf[i];
+}
+
+slog_buf *slog_buf_thread (void) {
+    return slog_buf_thread_at (SLOG_BUF_ENTRY);
+}
+
+void slog_buf_release (slog_buf *buf) {
+    if (buf->size <= SLOG_BUFSIZ_KEEP)
+        return;
+
+    char *p = slog_realloc (buf->data, SLOG_BUFSIZ);
+    if (p) {
+        buf->data = p;
+        buf->size = SLOG_BUFSIZ;
+    }
+}
+
+unsigned long long slog_buf_growths (void) {
+    return slog_buf_grown_;
+}
@@ -0,0 +1,99 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+#ifndef __SLOG_BUF_H__
+#define __SLOG_BUF_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "slog_export.h"
+#include "slog_fmt.h"
+#include <stddef.h>
+#include <stdarg.h>
+
+/* This defines the size of the primary allocation of strings for
+ * slog_*fmt_get_str () functions and of the per-thread buffers */
+#define SLOG_BUFSIZ     512
+/* per-thread buffers, which have grown beyond this size, are shrunk
+ * back to SLOG_BUFSIZ after use */
+#define SLOG_BUFSIZ_KEEP (64 * 1024)
+/* the reusable buffers of a thread (see: slog_buf_thread_at ()) */
+enum {
+    /* the entry */
+    SLOG_BUF_ENTRY,
+    /* the message, formatted once for all sinks */
+    SLOG_BUF_MESSAGE,
+    /* the message, before it is escaped by the formatter, and the
+     * colored copy of an entry for stdout */
+    SLOG_BUF_SCRATCH,
+
+    SLOG_BUF_THREAD
+};
+
+/* an output buffer for the formatter */
+typedef struct slog_buf {
+    char  *data;
+    /* number of bytes the output takes, may exceed size for fixed buffers */
+    size_t len;
+    size_t size;
+    /* the buffer belongs to the caller and is never reallocated,
+     * the output is truncated instead */
+    unsigned char fixed;
+    /* an allocation has failed, the contents are incomplete */
+    unsigned char failed;
+} slog_buf;
+
+/* slog_buf_init - initialize a buffer
+ * @param buf
+ *   pointer to the slog_buf structure
+ * @param data
+ *   caller supplied storage, or NULL for a growable buffer
+ * @param size
+ *   size of the storage or of the initial allocation
+ * @return
+ *   0 on success, non-zero otherwise */
+SLOG_API char slog_buf_init (slog_buf *buf, char *data, size_t size);
+/* slog_buf_reserve - make room for `n` more bytes and the terminating NUL
+ * @return
+ *   number of bytes, which can actually be written at buf->data + buf->len */
+SLOG_API size_t slog_buf_reserve (slog_buf *buf, size_t n);
+/* slog_buf_append - append `n` bytes of `str` */
+SLOG_API void slog_buf_append (slog_buf *buf, const char *str, size_t n);
+/* slog_buf_vprintf - append the message formatted as by vsnprintf (),
+ * in a single pass (see: slog_printf.c). The list is not consumed */
+SLOG_API void slog_buf_vprintf (slog_buf *buf, const char *fmt, va_list *list);
+/* slog_buf_terminate - NUL-terminate the (possibly truncated) contents */
+SLOG_API void slog_buf_terminate (slog_buf *buf);
+
+/* slog_buf_thread - get the calling thread's reusable buffer, which
+ * is emptied and only grows when an entry does not fit into it
+ * @return
+ *   valid pointer to the slog_buf structure, NULL otherwise */
+SLOG_API slog_buf *slog_buf_thread (void);
+/* slog_buf_thread_at - get one of the thread's reusable buffers, the
+ * first one is returned by slog_buf_thread ()
+ * @param i
+ *   index of the buffer, less than SLOG_BUF_THREAD
+ * @return
+ *   valid pointer to the slog_buf structure, NULL otherwise */
+SLOG_API slog_buf *slog_buf_thread_at (unsigned int i);
+/* slog_buf_release - done with the thread's buffer, an unusually
+ * large allocation is given back here */
+SLOG_API void slog_buf_release (slog_buf *buf);
+/* slog_buf_growths - get the number of reallocations of growing buffers
+ * done by the calling thread so far */
+SLOG_API unsigned long long slog_buf_growths (void);
+
+/* "00" to "99", two digits of a decimal number at a time */
+SLOG_API extern const char slog_digits2[201];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
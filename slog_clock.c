@@ -0,0 +1,162 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+/* The clock sources of the entry timestamps. The TSC source converts the
+ * time stamp counter to nanoseconds with a fixed point multiplier, which
+ * is measured once against CLOCK_MONOTONIC, and adds it to the wall clock
+ * time read at the calibration. It does not follow later adjustments of
+ * the system clock. */
+
+#include "slog.h"
+#include "slog_clock.h"
+#include "slog_log.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#if defined (__x86_64__) && (defined (__GNUC__) || defined (__clang__))
+#   define __slog_tsc 1
+#   include <cpuid.h>
+#   include <x86intrin.h>
+#endif
+
+#define SLOG_NSEC 1000000000LL
+
+#ifdef CLOCK_REALTIME_COARSE
+#   define SLOG_CLOCK_COARSE CLOCK_REALTIME_COARSE
+#   define SLOG_CLOCK_MONO_COARSE CLOCK_MONOTONIC_COARSE
+#else
+#   define SLOG_CLOCK_COARSE CLOCK_REALTIME
+#   define SLOG_CLOCK_MONO_COARSE CLOCK_MONOTONIC
+#endif
+
+static atomic_int slog_clock_source_ = slog_clock_realtime;
+
+static pthread_once_t slog_clock_once_ = PTHREAD_ONCE_INIT;
+/* CLOCK_MONOTONIC at slog_clock_init () */
+static long long slog_clock_start_;
+
+#if __slog_tsc
+static pthread_once_t slog_tsc_once_ = PTHREAD_ONCE_INIT;
+/* the calibration, written once before the source is switched */
+static struct {
+    /* 0 if the TSC is not usable */
+    uint64_t mult;
+    uint64_t tsc0;
+    /* wall clock and CLOCK_MONOTONIC nanoseconds at tsc0 */
+    long long real0,
+              mono0;
+} slog_tsc_;
+#endif
+
+static long long _ns (clockid_t id) {
+    struct timespec ts;
+    clock_gettime (id, &ts);
+    return ts.tv_sec * SLOG_NSEC + ts.tv_nsec;
+}
+
+static void _clock_start (void) {
+    slog_clock_start_ = _ns (CLOCK_MONOTONIC);
+}
+
+void slog_clock_init (void) {
+    pthread_once (&slog_clock_once_, _clock_start);
+}
+
+#if __slog_tsc
+/* the TSC runs at a constant rate in every power state */
+static int _tsc_invariant (void) {
+    unsigned int a, b, c, d;
+    if (!__get_cpuid (0x80000000, &a, &b, &c, &d) || a < 0x80000007)
+        return 0;
+    __get_cpuid (0x80000007, &a, &b, &c, &d);
+    return (d >> 8) & 1;
+}
+
+static void _tsc_calibrate (void) {
+    if (!_tsc_invariant ())
+        return;
+
+    struct timespec nap = { 0, 20 * 1000 * 1000 };
+    long long m0 = _ns (CLOCK_MONOTONIC);
+    uint64_t t0 = __rdtsc ();
+    nanosleep (&nap, NULL);
+    long long m1 = _ns (CLOCK_MONOTONIC);
+    uint64_t t1 = __rdtsc ();
+    if (t1 <= t0 || m1 <= m0)
+        return;
+
+    /* nanoseconds per tick in 32.32 fixed point */
+    slog_tsc_.mult  = (uint64_t)(((unsigned __int128)(m1 - m0) << 32) / (t1 - t0));
+    slog_tsc_.tsc0  = t1;
+    slog_tsc_.mono0 = m1;
+    slog_tsc_.real0 = _ns (CLOCK_REALTIME);
+}
+
+/* nanoseconds since the calibration */
+static long long _tsc_ns (void) {
+    return (long long)(((unsigned __int128)(__rdtsc () - slog_tsc_.tsc0) * slog_tsc_.mult) >> 32);
+}
+#endif
+
+char slog_set_clock (slog_clock clock) {
+    if (clock == slog_clock_tsc) {
+#if __slog_tsc
+        pthread_once (&slog_tsc_once_, _tsc_calibrate);
+        if (!slog_tsc_.mult) {
+            slog_log_error ("The time stamp counter is not invariant");
+            return 1;
+        }
+#else
+        slog_log_error ("The time stamp counter is not supported on this platform");
+        return 1;
+#endif
+    } else if (clock != slog_clock_realtime && clock != slog_clock_coarse) {
+        return 1;
+    }
+    atomic_store_explicit (&slog_clock_source_, clock, memory_order_release);
+    return 0;
+}
+
+void slog_clock_now (struct timespec *ts) {
+    switch (atomic_load_explicit (&slog_clock_source_, memory_order_acquire)) {
+#if __slog_tsc
+        case slog_clock_tsc: {
+            long long ns = slog_tsc_.real0 + _tsc_ns ();
+            ts->tv_sec  = ns / SLOG_NSEC;
+            ts->tv_nsec = ns % SLOG_NSEC;
+            return;
+        }
+#endif
+        case slog_clock_coarse:
+            clock_gettime (SLOG_CLOCK_COARSE, ts);
+            return;
+        default:
+            clock_gettime (CLOCK_REALTIME, ts);
+            return;
+    }
+}
+
+long long slog_clock_elapsed (void) {
+    long long ns;
+    slog_clock_init ();
+    switch (atomic_load_explicit (&slog_clock_source_, memory_order_acquire)) {
+#if __slog_tsc
+        case slog_clock_tsc:
+            ns = slog_tsc_.mono0 + _tsc_ns ();
+            break;
+#endif
+        case slog_clock_coarse:
+            ns = _ns (SLOG_CLOCK_MONO_COARSE);
+            break;
+        default:
+            ns = _ns (CLOCK_MONOTONIC);
+            break;
+    }
+    /* the coarse clock may lag behind the start */
+    return ns > slog_clock_start_ ? ns - slog_clock_start_ : 0;
+}
@@ -0,0 +1,26 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+#ifndef __SLOG_CLOCK_H__
+#define __SLOG_CLOCK_H__
+
+#include "slog_export.h"
+#include <time.h>
+
+/* slog_clock_init - remember the start of the monotonic elapsed time,
+ * the first call wins */
+SLOG_API void slog_clock_init (void);
+/* slog_clock_now - read the wall clock with the source selected by
+ * slog_set_clock ()
+ * @param ts
+ *   where the time is stored */
+SLOG_API void slog_clock_now (struct timespec *ts);
+/* slog_clock_elapsed - monotonic time since slog_clock_init ()
+ * @return
+ *   elapsed nanoseconds */
+SLOG_API long long slog_clock_elapsed (void);
+
+#endif
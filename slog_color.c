@@ -6,31 +6,56 @@
 
 #include "slog_color.h"
 #include <stdio.h>
+#include <string.h>
 
 #if defined(__linux) || defined(__linux__) || defined (__unix) || defined (__unix__)
 #define __slog_unix 1
-const char *slog_unix_map[] = {
-    "\033[31m",
-    "\033[33m",
-    "\033[37m",
-    "\033[30m",
-    "\033[0m",
+#include <unistd.h>
+
+#define _color_code(seq) { seq, sizeof (seq) - 1 }
+/* the escape sequences with their lengths, no strlen () per entry */
+static const struct {
+    const char *seq;
+    size_t len;
+} slog_unix_map[] = {
+    _color_code ("\033[31m"),
+    _color_code ("\033[33m"),
+    _color_code ("\033[37m"),
+    _color_code ("\033[30m"),
+    _color_code ("\033[0m"),
 };
 #endif
 
 void slog_set_color (const slog_color color) {
 #if __slog_unix
-    fwrite (slog_unix_map[color], 1, 5, stdout);
+    fwrite (slog_unix_map[color].seq, 1, slog_unix_map[color].len, stdout);
 #else
     return;
 #endif
 }
 
-/* might not work, gotta find a fix */
 void slog_reset_color () {
 #if __slog_unix
-    fwrite (slog_unix_map[slog_color_reset], 1, 4, stdout);
+    fwrite (slog_unix_map[slog_color_reset].seq, 1, slog_unix_map[slog_color_reset].len, stdout);
 #else
     return;
 #endif
 }
+
+const char *slog_color_code (const slog_color color, size_t *len) {
+#if __slog_unix
+    *len = slog_unix_map[color].len;
+    return slog_unix_map[color].seq;
+#else
+    *len = 0;
+    return "";
+#endif
+}
+
+int slog_color_tty (void) {
+#if __slog_unix
+    return isatty (STDOUT_FILENO);
+#else
+    return 0;
+#endif
+}
@@ -8,6 +8,7 @@
 #define __SLOG_COLOR_H__
 
 #include "slog_export.h"
+#include <stddef.h>
 
 typedef enum {
     slog_color_red,
@@ -24,5 +25,18 @@ typedef enum {
 
 SLOG_API void slog_set_color (const slog_color color);
 SLOG_API void slog_reset_color ();
+/* slog_color_code - get the escape sequence of a color
+ * @param color
+ *   the color, slog_color_reset for the sequence restoring the default
+ * @param len
+ *   where the length of the sequence is stored
+ * @return
+ *   the sequence, empty where the colors are not supported */
+SLOG_API const char *slog_color_code (const slog_color color, size_t *len);
+/* slog_color_tty - check whether stdout is a terminal, which understands
+ * the escape sequences
+ * @return
+ *   non-zero if it is */
+SLOG_API int slog_color_tty (void);
 
 #endif
@@ -0,0 +1,179 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+/* Direct streams bypass stdio: an entry, together with its color escapes,
+ * is written with a single writev () per destination. The writer thread
+ * of an asynchronous stream copies the entries of a batch into one buffer
+ * per destination instead, and writes each buffer with a single call at
+ * the end of the batch (or whenever it fills up). */
+
+#include "slog_stream.h"
+#include "slog_color.h"
+#include "slog_log.h"
+#include "slog_mem.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/* color, entry without the newline, reset, newline */
+#define SLOG_DIRECT_IOV 4
+
+/* write all of iov, resuming after signals and short writes */
+static char _direct_writev (int fd, struct iovec *iov, int n) {
+    while (n > 0) {
+        ssize_t w = writev (fd, iov, n);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            return 1;
+        }
+        for (; n > 0 && (size_t)w >= iov->iov_len; ++iov, --n)
+            w -= iov->iov_len;
+        if (n > 0) {
+            iov->iov_base = (char *)iov->iov_base + w;
+            iov->iov_len -= w;
+        }
+    }
+    return 0;
+}
+
+/* the pieces of an entry for stdout, the reset goes before the newline,
+ * so that the color does not leak into the next line */
+static int _direct_gather_stdout (struct iovec *iov, const slog_stream *stream,
+        const slog_loglevel *level, const char *entry, size_t len) {
+    if (!slog_stream_colorized (stream) || !level || !len || entry[len - 1] != '\n') {
+        iov[0].iov_base = (char *)entry;
+        iov[0].iov_len  = len;
+        return 1;
+    }
+
+    size_t n;
+    iov[0].iov_base = (char *)slog_color_code (level->color, &n);
+    iov[0].iov_len  = n;
+    iov[1].iov_base = (char *)entry;
+    iov[1].iov_len  = len - 1;
+    iov[2].iov_base = (char *)slog_color_code (slog_color_reset, &n);
+    iov[2].iov_len  = n;
+    iov[3].iov_base = (char *)"\n";
+    iov[3].iov_len  = 1;
+    return 4;
+}
+
+static char _direct_flush_buf (slog_buf *buf, int fd) {
+    if (!buf->len)
+        return 0;
+
+    struct iovec iov = { buf->data, buf->len };
+    buf->len = 0;
+    return _direct_writev (fd, &iov, 1);
+}
+
+/* copy the pieces into the buffer, writing it out first if they do not
+ * fit, pieces larger than the whole buffer are written right away */
+static char _direct_put (slog_stream *stream, slog_buf *buf, int fd, struct iovec *iov, int n) {
+    size_t total = 0;
+    int i;
+    for (i = 0; i < n; ++i)
+        total += iov[i].iov_len;
+
+    if (!buf->data) {
+        char *data = slog_mem_alloc (&stream->alloc, SLOG_DIRECT_BUFSIZ);
+        if (!data)
+            return _direct_writev (fd, iov, n);
+        slog_buf_init (buf, data, SLOG_DIRECT_BUFSIZ);
+    }
+    char failed = 0;
+    if (buf->len + total > buf->size)
+        failed = _direct_flush_buf (buf, fd);
+    if (total > buf->size)
+        return _direct_writev (fd, iov, n) || failed;
+
+    for (i = 0; i < n; ++i) {
+        memcpy (buf->data + buf->len, iov[i].iov_base, iov[i].iov_len);
+        buf->len += iov[i].iov_len;
+    }
+    return failed;
+}
+
+void slog_direct_write (slog_stream *stream, const slog_loglevel *level,
+        const char *entry, size_t len, char batch) {
+    struct iovec iov[SLOG_DIRECT_IOV];
+    int n;
+
+    if (slog_stream_stdout (stream)) {
+        n = _direct_gather_stdout (iov, stream, level, entry, len);
+        size_t total = 0;
+        int i;
+        for (i = 0; i < n; ++i)
+            total += iov[i].iov_len;
+        slog_stream_count (stream, bytes_stdout, total);
+        if (batch
+                ? _direct_put (stream, &stream->dout, STDOUT_FILENO, iov, n)
+                : _direct_writev (STDOUT_FILENO, iov, n))
+            slog_stream_count (stream, write_errors, 1);
+    }
+    if (!stream->has_file)
+        return;
+
+    unsigned long long flushed = 0;
+    /* a batch is flushed as a whole by the writer thread */
+    int flush = !batch && slog_flush_due (stream, level);
+    iov[0].iov_base = (char *)entry;
+    iov[0].iov_len  = len;
+
+    pthread_mutex_lock (&stream->lock);
+    FILE *prev = slog_rotate_check (stream, len);
+    int fd = fileno (stream->file);
+    char failed;
+    if (stream->map.enabled)
+        failed = slog_map_write (stream, entry, len);
+    else if (batch)
+        failed = _direct_put (stream, &stream->dfile, fd, iov, 1);
+    else
+        failed = _direct_writev (fd, iov, 1);
+    if (failed) {
+        slog_stream_count (stream, write_errors, 1);
+        slog_log_error ("Failed to write log entry to %s: %s", stream->path, strerror (errno));
+    }
+    slog_stream_count (stream, bytes_file, len);
+    stream->rot.bytes += len;
+    if (flush)
+        flushed = slog_flush_file (stream);
+    pthread_mutex_unlock (&stream->lock);
+
+    if (prev)
+        slog_rotate_finish (stream, prev);
+    if (flushed && slog_flush_syncs (stream))
+        slog_flush_sync (stream, flushed);
+}
+
+void slog_direct_flush_file (slog_stream *stream) {
+    if (stream->dfile.len && _direct_flush_buf (&stream->dfile, fileno (stream->file))) {
+        slog_stream_count (stream, write_errors, 1);
+        slog_log_error ("Failed to write log entry to %s: %s", stream->path, strerror (errno));
+    }
+}
+
+void slog_direct_flush (slog_stream *stream) {
+    if (_direct_flush_buf (&stream->dout, STDOUT_FILENO))
+        slog_stream_count (stream, write_errors, 1);
+    if (stream->has_file) {
+        pthread_mutex_lock (&stream->lock);
+        slog_direct_flush_file (stream);
+        pthread_mutex_unlock (&stream->lock);
+    }
+}
+
+void slog_direct_clear (slog_stream *stream) {
+    if (stream->dout.data)
+        slog_mem_free (&stream->alloc, stream->dout.data);
+    if (stream->dfile.data)
+        slog_mem_free (&stream->alloc, stream->dfile.data);
+    memset (&stream->dout, 0, sizeof (slog_buf));
+    memset (&stream->dfile, 0, sizeof (slog_buf));
+}
@@ -0,0 +1,51 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+#ifndef __SLOG_ENTRY_H__
+#define __SLOG_ENTRY_H__
+
+#include "slog.h"
+#include "slog_export.h"
+#include "slog_buf.h"
+#include "slog_fmt.h"
+#include <stdarg.h>
+#include <time.h>
+
+/* a log entry on its way through the formatter */
+typedef struct slog_entry {
+    const slog_loglevel *level;
+    /* message, or message format if list is set (as in token %L) */
+    const char *mfmt;
+    va_list *list;
+    /* fields of a structured entry (see: slog_kv ()), NULL if there are none */
+    va_list *kv;
+    /* time of the entry, the formatter takes the current
+     * time unless has_time is set */
+    struct timespec ts;
+    unsigned char has_time;
+    /* monotonic nanoseconds since the start (token %e), the formatter
+     * reads the clock unless has_elapsed is set */
+    long long elapsed;
+    unsigned char has_elapsed;
+    /* where the entry was logged from (tokens %F, %i, %C), may be NULL */
+    slog_site *site;
+    /* renders the message instead of mfmt (see: slog_render_at ()) */
+    slog_renderer render;
+    const void *ctx;
+} slog_entry;
+
+/* slog_fmt_entry - append an entry formed with a slog_fmt to a buffer
+ * @param out
+ *   output buffer
+ * @param fmt
+ *   format to be used on the entry
+ * @param entry
+ *   the entry
+ * @return
+ *   0 on success, non-zero otherwise */
+SLOG_API char slog_fmt_entry (slog_buf *out, slog_fmt *fmt, const slog_entry *entry);
+
+#endif
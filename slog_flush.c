@@ -0,0 +1,268 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+/* Flush policies and group commit. Whether an entry is followed by a flush
+ * is decided without the stream lock: a loglevel bitset and a counter of
+ * the entries. The interval is kept by a thread of the stream, which wakes
+ * up every interval_ms and flushes, if anything was written meanwhile, so
+ * that the last entries before an idle period do not stay in the buffers
+ * of stdio. The flush itself hands the
+ * buffered output of the file to the kernel under the stream lock and
+ * numbers it. A writer, which needs its flush on disk, waits until the
+ * synced number reaches its own: the first one to arrive calls fdatasync ()
+ * on behalf of everybody, whose flush was done before the sync started,
+ * the others wait for it and then either return or start the next sync
+ * for the flushes, which came in meanwhile. */
+
+#include "slog_stream.h"
+#include "slog_log.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+void slog_flush_init (slog_stream *stream) {
+    slog_flusher *f = &stream->flush;
+    atomic_init (&f->enabled, 0);
+    atomic_init (&f->entries, 0);
+    atomic_init (&f->interval_ms, 0);
+    slog_levelset_mask (f->levels, 0, 1);
+    atomic_init (&f->sync, 0);
+    atomic_init (&f->count, 0);
+    f->pending  = 0;
+    f->flushed  = 0;
+    f->synced   = 0;
+    f->syncing  = 0;
+    f->timing   = 0;
+    f->stop     = 0;
+    pthread_mutex_init (&f->lock, NULL);
+    pthread_cond_init (&f->done, NULL);
+
+    /* the interval is not affected by changes of the wall clock */
+    pthread_condattr_t attr;
+    pthread_condattr_init (&attr);
+    pthread_condattr_setclock (&attr, CLOCK_MONOTONIC);
+    pthread_cond_init (&f->tick, &attr);
+    pthread_condattr_destroy (&attr);
+}
+
+void slog_flush_clear (slog_stream *stream) {
+    pthread_mutex_destroy (&stream->flush.lock);
+    pthread_cond_destroy (&stream->flush.done);
+    pthread_cond_destroy (&stream->flush.tick);
+}
+
+/* everything written to the outputs of the stream so far */
+static unsigned long long _flush_written (slog_stream *stream) {
+    unsigned long long n = atomic_load_explicit (&stream->stats.bytes_stdout, memory_order_relaxed)
+        + atomic_load_explicit (&stream->stats.bytes_file, memory_order_relaxed);
+    unsigned int i, nsinks = atomic_load_explicit (&stream->nsinks, memory_order_acquire);
+    for (i = 0; i < nsinks; ++i)
+        n += atomic_load_explicit (&stream->stats.bytes_sinks[i], memory_order_relaxed);
+    return n;
+}
+
+/* flush the stream every interval_ms, if it has been written to. The
+ * counters are updated after the writes, so an entry missed by one round
+ * is flushed by the next one */
+static void *_flush_timer (void *arg) {
+    slog_stream *stream = arg;
+    slog_flusher *f = &stream->flush;
+    /* whatever was written before the policy is flushed as well */
+    unsigned long long seen = 0;
+    struct timespec ts;
+
+    pthread_mutex_lock (&f->lock);
+    while (!f->stop) {
+        unsigned int ms = atomic_load_explicit (&f->interval_ms, memory_order_relaxed);
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        ts.tv_sec  += ms / 1000;
+        ts.tv_nsec += (long)(ms % 1000) * 1000000l;
+        if (ts.tv_nsec >= 1000000000l) {
+            ts.tv_sec  += 1;
+            ts.tv_nsec -= 1000000000l;
+        }
+        if (pthread_cond_timedwait (&f->tick, &f->lock, &ts) != ETIMEDOUT || f->stop)
+            continue;
+
+        unsigned long long written = _flush_written (stream);
+        if (written == seen)
+            continue;
+        seen = written;
+        pthread_mutex_unlock (&f->lock);
+        slog_flush (stream, slog_flush_syncs (stream));
+        pthread_mutex_lock (&f->lock);
+    }
+    pthread_mutex_unlock (&f->lock);
+    return NULL;
+}
+
+void slog_flush_stop (slog_stream *stream) {
+    slog_flusher *f = &stream->flush;
+
+    pthread_mutex_lock (&f->lock);
+    int timing = f->timing;
+    f->stop = 1;
+    pthread_cond_signal (&f->tick);
+    pthread_mutex_unlock (&f->lock);
+    if (!timing)
+        return;
+
+    pthread_join (f->timer, NULL);
+    pthread_mutex_lock (&f->lock);
+    f->timing = 0;
+    pthread_mutex_unlock (&f->lock);
+}
+
+/* start the thread of the interval, or let it wait for the new one */
+static char _flush_start (slog_stream *stream) {
+    slog_flusher *f = &stream->flush;
+    char failed = 0;
+
+    pthread_mutex_lock (&f->lock);
+    if (f->timing) {
+        pthread_cond_signal (&f->tick);
+    } else {
+        f->stop = 0;
+        failed = pthread_create (&f->timer, NULL, _flush_timer, stream) != 0;
+        f->timing = !failed;
+    }
+    pthread_mutex_unlock (&f->lock);
+    if (failed)
+        slog_log_error ("Failed to start the flush thread");
+    return failed;
+}
+
+int slog_flush_check (slog_stream *stream, const slog_loglevel *level) {
+    slog_flusher *f = &stream->flush;
+
+    if (level && slog_levelset_has (f->levels, level))
+        return 1;
+
+    unsigned int n = atomic_load_explicit (&f->entries, memory_order_relaxed);
+    return n && atomic_fetch_add_explicit (&f->count, 1, memory_order_relaxed) % n == n - 1;
+}
+
+unsigned long long slog_flush_file (slog_stream *stream) {
+    /* a mapped file is in the page cache already */
+    if (stream->direct)
+        slog_direct_flush_file (stream);
+    else if (!stream->map.enabled && fflush (stream->file) != 0) {
+        slog_stream_count (stream, write_errors, 1);
+        slog_log_error ("Failed to flush %s: %s", stream->path, strerror (errno));
+    }
+    slog_stream_count (stream, flushes, 1);
+    return ++stream->flush.flushed;
+}
+
+char slog_flush_sync (slog_stream *stream, unsigned long long n) {
+    slog_flusher *f = &stream->flush;
+    char failed = 0;
+
+    pthread_mutex_lock (&f->lock);
+    while (f->synced < n && !failed) {
+        if (f->syncing) {
+            pthread_cond_wait (&f->done, &f->lock);
+            continue;
+        }
+        f->syncing = 1;
+        pthread_mutex_unlock (&f->lock);
+
+        /* everything flushed so far goes with this sync. A rotation may
+         * replace the file meanwhile (after syncing it, see:
+         * slog_flush_retire ()), the duplicate keeps this one open */
+        pthread_mutex_lock (&stream->lock);
+        unsigned long long target = f->flushed;
+        int fd = dup (fileno (stream->file));
+        pthread_mutex_unlock (&stream->lock);
+
+        failed = fd < 0 || fdatasync (fd) != 0;
+        if (failed) {
+            slog_stream_count (stream, write_errors, 1);
+            slog_log_error ("Failed to sync %s: %s", stream->path, strerror (errno));
+        }
+        if (fd >= 0)
+            close (fd);
+        slog_stream_count (stream, syncs, 1);
+
+        pthread_mutex_lock (&f->lock);
+        f->syncing = 0;
+        /* the waiters retry a failed sync themselves */
+        if (!failed)
+            f->synced = target;
+        pthread_cond_broadcast (&f->done);
+    }
+    pthread_mutex_unlock (&f->lock);
+    return failed;
+}
+
+void slog_flush_retire (slog_stream *stream) {
+    if (!slog_flush_syncs (stream))
+        return;
+
+    if (!stream->map.enabled)
+        fflush (stream->file);
+    if (fdatasync (fileno (stream->file)) != 0) {
+        slog_stream_count (stream, write_errors, 1);
+        slog_log_error ("Failed to sync %s: %s", stream->path, strerror (errno));
+    }
+    slog_stream_count (stream, syncs, 1);
+}
+
+char slog_set_flush (slog_stream *stream, const slog_flush_policy *policy) {
+    assert (stream != NULL);
+
+    slog_flusher *f = &stream->flush;
+    if (!policy) {
+        atomic_store_explicit (&f->enabled, 0, memory_order_relaxed);
+        atomic_store_explicit (&f->sync, 0, memory_order_relaxed);
+        slog_flush_stop (stream);
+        return 0;
+    }
+
+    if (policy->sync) {
+        struct stat st;
+        if (!stream->has_file || fstat (fileno (stream->file), &st) != 0 || !S_ISREG (st.st_mode)) {
+            slog_log_error ("Only streams writing to a regular file can be synced");
+            return 1;
+        }
+    }
+
+    pthread_mutex_lock (&stream->lock);
+    atomic_store_explicit (&f->entries, policy->entries, memory_order_relaxed);
+    atomic_store_explicit (&f->interval_ms, policy->interval_ms, memory_order_relaxed);
+    slog_levelset_mask (f->levels, policy->levels, 1);
+    atomic_store_explicit (&f->count, 0, memory_order_relaxed);
+    atomic_store_explicit (&f->sync, policy->sync != 0, memory_order_relaxed);
+    atomic_store_explicit (&f->enabled, policy->entries || policy->levels, memory_order_relaxed);
+    pthread_mutex_unlock (&stream->lock);
+
+    if (policy->interval_ms)
+        return _flush_start (stream);
+    slog_flush_stop (stream);
+    return 0;
+}
+
+char slog_flush (slog_stream *stream, char sync) {
+    assert (stream != NULL);
+
+    slog_drain (stream);
+    unsigned int i, n = atomic_load_explicit (&stream->nsinks, memory_order_acquire);
+    for (i = 0; i < n; ++i)
+        slog_sink_flush (stream->sinks[i]);
+    if (slog_stream_stdout (stream) && !stream->direct)
+        fflush (stdout);
+    if (!stream->has_file)
+        return 0;
+
+    pthread_mutex_lock (&stream->lock);
+    unsigned long long flushed = slog_flush_file (stream);
+    pthread_mutex_unlock (&stream->lock);
+    return sync ? slog_flush_sync (stream, flushed) : 0;
+}
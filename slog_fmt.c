@@ -7,13 +7,12 @@
 /* I AM MAKING A VERY BOLD ASSUMPTION HERE 
  * THAT THE TM_BASE_YEAR IS ALWAYS 1900 */
 #define SLOG_BASE_YEAR 1900
-/* This defines the size of the primary allocation of strings for
- * slog_*fmt_get_str () functions.
- * Returned strings will be aligned to this size, so they're going 
- * to be a multiple of this value */
-#define SLOG_BUFSIZ     512
 
 #include "slog_fmt.h"
+#include "slog_buf.h"
+#include "slog_clock.h"
+#include "slog_entry.h"
+#include "slog_kv.h"
 #include "slog_log.h"
 #include "slog_mem.h"
 
@@ -35,241 +34,155 @@ typedef enum slog_token {
     slog_token_month,
     slog_token_year2,
     slog_token_year4,
-    slog_token_space,
     slog_token_literal,
     slog_token_message,
     slog_token_timestamp,
-    slog_token_runtime
+    slog_token_runtime,
+    slog_token_msec,
+    slog_token_usec,
+    slog_token_nsec,
+    slog_token_rfc3339,
+    slog_token_elapsed,
+    slog_token_json,
+    slog_token_logfmt,
+    slog_token_file,
+    slog_token_line,
+    slog_token_func,
+    /* the UTC offset part of slog_token_rfc3339, not a format character */
+    slog_token_zone,
+
+    slog_token_count
 } slog_token;
 
-struct slog_fmt_tok {
+/* an instruction of the compiled format */
+struct slog_fmt_op {
     slog_token token;
-    struct slog_fmt_tok *next;
-};
-struct slog_fmt_str {
-    const char *str;
-    slog_fmt_str *next;
+    /* slog_token_literal: a run in the literal pool of the format */
+    unsigned int off,
+                 len;
 };
 
-static slog_fmt_tok *_alloc_head () {
-    slog_fmt_tok *p = slog_xalloc (sizeof (slog_fmt_tok));
-    if (!p)
-        return NULL;
-    p->token = slog_token_none;
-    p->next = NULL;
-    return p;
-}
-static slog_fmt_str *_alloc_head_str () {
-    slog_fmt_str *p = slog_xalloc (sizeof (slog_fmt_str));
-    if (!p)
-        return NULL;
-    p->str = NULL;
-    p->next = NULL;
-    return p;
-}
+typedef enum { slog_false = 0, slog_true } slog_bool;
 
-static slog_fmt_tok *_add_node (const slog_token token, slog_fmt_tok *fmt) {
-    if (fmt->token != slog_token_none) {
-        while (fmt->next) fmt = fmt->next;
-        fmt->next = slog_xalloc (sizeof (slog_fmt_tok));
-        if (!fmt)
-            return NULL;
-        fmt = fmt->next;
+/* get the token for the character after '%',
+ * slog_token_none if there is no such token */
+static slog_token _token_of (char c) {
+    switch (c) {
+        case 'c': return slog_token_ctime;
+        case 'h': return slog_token_hour12;
+        case 'H': return slog_token_hour24;
+        case 'm': return slog_token_minutes;
+        case 's': return slog_token_seconds;
+        case 'd': return slog_token_day;
+        case 'M': return slog_token_month;
+        case 'y': return slog_token_year2;
+        case 'Y': return slog_token_year4;
+        case 'p': return slog_token_runtime;
+        case 'P': return slog_token_timestamp;
+        case 'f': return slog_token_msec;
+        case 'u': return slog_token_usec;
+        case 'N': return slog_token_nsec;
+        case 'T': return slog_token_rfc3339;
+        case 'e': return slog_token_elapsed;
+        case 'J': return slog_token_json;
+        case 'K': return slog_token_logfmt;
+        case 'F': return slog_token_file;
+        case 'i': return slog_token_line;
+        case 'C': return slog_token_func;
+        case 'l': return slog_token_level;
+        case 'L': return slog_token_message;
+        default:  return slog_token_none;
     }
-    fmt->next = NULL;
-    fmt->token = token;
-
-    return fmt;
 }
-static slog_fmt_str *_add_node_str (const char *str, slog_fmt_str *fmt) {
-    if (fmt->str != NULL) {
-        while (fmt->next) fmt = fmt->next;
-        fmt->next = slog_xalloc (sizeof (slog_fmt_str));
-        if (!fmt)
-            return NULL;
-        fmt = fmt->next;
-    }
-    fmt->next = NULL;
-    
-    size_t len = strlen (str) + 1;
-    fmt->str = slog_xalloc (len);
-    memcpy ((char *)fmt->str, str, len);
 
-    return fmt;
+/* compile the format string into ops and the literal pool, if `ops` is NULL
+ * only the number of ops and the size of the pool are counted.
+ * Literal characters, "%%" and "% " are constant, so the adjacent ones
+ * are merged into a single literal op.
+ * Returns 0 on success, non-zero on a syntax error */
+static char _fmt_compile (const char *str, slog_fmt_op *ops, char *lits, size_t *nops, size_t *nlits) {
+#define addop(t) {\
+    if (ops) {\
+        ops[n].token = t;\
+        ops[n].off = ops[n].len = 0;\
+    }\
+    ++n;\
 }
-static void _slog_fmt_tok_clear (slog_fmt_tok *fmt) {
-    assert (fmt != NULL);
-    slog_fmt_tok *p = fmt;
-    while (fmt) {
-        p = fmt->next;
-        slog_free (fmt);
-        fmt = p;
-    }
+#define addchar(x) {\
+    if (!text) {\
+        addop (slog_token_literal);\
+        if (ops)\
+            ops[n - 1].off = nl;\
+        text = slog_true;\
+    }\
+    if (ops) {\
+        lits[nl] = x;\
+        ++ops[n - 1].len;\
+    }\
+    ++nl;\
 }
-static void _slog_fmt_str_clear (slog_fmt_str *fmt_str) {
-    assert (fmt_str != NULL);
-    slog_fmt_str *p = fmt_str;
-    while (fmt_str) {
-        p = fmt_str->next;
-        if (fmt_str->str)
-            slog_free ((char *)fmt_str->str);
-        slog_free (fmt_str);
-        fmt_str = p;
+    size_t n = 0, nl = 0;
+    /* is the last op a literal */
+    slog_bool text = slog_false;
+    const char *p;
+
+    for (p = str; *p; ++p) {
+        if (*p != '%') {
+            addchar (*p);
+            continue;
+        }
+        ++p;
+        if (!(*p))
+            break;
+        if (*p == '%' || *p == ' ') {
+            addchar (*p);
+            continue;
+        }
+
+        slog_token t = _token_of (*p);
+        if (t == slog_token_none)
+            return 1;
+        addop (t);
+        text = slog_false;
     }
+
+    *nops  = n;
+    *nlits = nl;
+    return 0;
+#undef addop
+#undef addchar
 }
 
-typedef enum { slog_false = 0, slog_true } slog_bool;
 slog_fmt *slog_fmt_create (const char *str) {
-#define addchar(x) {\
-    *pb = x;\
-    ++pb;\
+    return slog_fmt_create_with (str, NULL);
 }
-#define untext()\
-    if (text) {\
-        text = slog_false;\
-        *pb = 0x0;\
-        _add_node_str (buf, fmtsp);\
-        pb = buf;\
-    }
-#define check_await()\
-    
-    assert (str != NULL);
-
-    /* fmt head node */
-    slog_fmt_tok *fmt_tok_head = _alloc_head (),
-    /* fmt last node */
-                 *fmtp = fmt_tok_head;
 
-    /* fmt_str head node */
-    slog_fmt_str *fmt_str_head = _alloc_head_str (),
-                 *fmtsp = fmt_str_head;
+slog_fmt *slog_fmt_create_with (const char *str, const slog_allocator *alloc) {
+    assert (str != NULL);
 
-    if (!fmt_str_head || !fmt_tok_head) {
-        slog_log_error ("Could not allocate memory for a format string");
+    size_t nops, nlits;
+    if (_fmt_compile (str, NULL, NULL, &nops, &nlits) != 0) {
+        slog_log_error ("Invalid format syntax");
         return NULL;
     }
 
-    char buf[SLOG_BUFSIZ],
-         *pb = buf;
-    const char *p = str;
-
-    size_t lit_size = 0;
-
-    /* is it a regular literal */
-    slog_bool text  = slog_false;
-    while (*p) {
-        if (*p == '%') {
-            ++p;
-            if (!(*p))
-                break;
-            switch (*p) {
-                case '%':
-                    addchar (*p);
-                    break;
-                case 'c':
-                    fmtp = _add_node (slog_token_ctime, fmtp);
-                    untext ();
-                    break;
-                case 'h':
-                    fmtp = _add_node (slog_token_hour12, fmtp);
-                    untext ();
-                    break;
-                case 'H':
-                    fmtp = _add_node (slog_token_hour24, fmtp);
-                    untext ();
-                    break;
-                case 'm':
-                    fmtp = _add_node (slog_token_minutes, fmtp);
-                    untext ();
-                    break;
-                case 's':
-                    fmtp = _add_node (slog_token_seconds, fmtp);
-                    untext ();
-                    break;
-                case 'd':
-                    fmtp = _add_node (slog_token_day, fmtp);
-                    untext ();
-                    break;
-                case 'M':
-                    fmtp = _add_node (slog_token_month, fmtp);
-                    untext ();
-                    break;
-                case 'y':
-                    fmtp = _add_node (slog_token_year2, fmtp);
-                    untext ();
-                    break;
-                case 'Y':
-                    fmtp = _add_node (slog_token_year4, fmtp);
-                    untext ();
-                    break;
-                case 'p':
-                    fmtp = _add_node (slog_token_runtime, fmtp);
-                    untext ();
-                    break;
-                case 'P':
-                    fmtp = _add_node (slog_token_timestamp, fmtp);
-                    untext ();
-                    break;
-                case ' ':
-                    if (text) {
-                        addchar (*p);
-                        break;
-                    }
-                    fmtp = _add_node (slog_token_space, fmtp);
-                    break;
-                case 'l':
-                    fmtp = _add_node (slog_token_level, fmtp);
-                    untext ();
-                    break;
-                case 'L':
-                    fmtp = _add_node (slog_token_message, fmtp);
-                    untext ();
-                    break;
-                default:
-                    slog_log_error ("Invalid format syntax");
-                    _slog_fmt_tok_clear (fmt_tok_head);
-                    _slog_fmt_str_clear (fmt_str_head);
-
-                    return NULL;
-            }
-        } else {
-                if (!text) {
-                    fmtp = _add_node (slog_token_literal, fmtp);
-                    text = slog_true;
-                    lit_size = 0;
-                }
-                ++lit_size;
-                if (lit_size >= SLOG_BUFSIZ) {
-                    slog_log_error ("Size of the string literal exceeds the size of the buffer!");
-                    _slog_fmt_tok_clear (fmt_tok_head);
-                    _slog_fmt_str_clear (fmt_str_head);
-
-                    return NULL;
-                }
-                addchar (*p);
-        }
-        ++p;
-
-    }
-
-    slog_fmt *res = slog_xalloc (sizeof (slog_fmt));
+    /* the structure, the ops and the literal pool share a single block */
+    slog_fmt *res = slog_mem_alloc (alloc, sizeof (slog_fmt) + nops * sizeof (slog_fmt_op) + nlits + 1);
     if (!res) {
-        _slog_fmt_tok_clear (fmt_tok_head);
-        _slog_fmt_str_clear (fmt_str_head);
+        slog_log_error ("Could not allocate memory for a format string");
         return NULL;
     }
-    res->fmt_tok_head = fmt_tok_head;
-    res->fmt_str_head = fmt_str_head;
-    
+    res->ops   = (slog_fmt_op *)(res + 1);
+    res->lits  = (char *)(res->ops + nops);
+    res->alloc = alloc;
+    (void)_fmt_compile (str, res->ops, res->lits, &res->nops, &nlits);
+    res->lits[nlits] = 0x0;
+
     return res;
-#undef addchar 
-#undef untext
 }
 void slog_fmt_clear (slog_fmt *p) {
     assert (p != NULL);
-    _slog_fmt_tok_clear (p->fmt_tok_head);
-    _slog_fmt_str_clear (p->fmt_str_head);
-    slog_free (p);
+    slog_mem_free (p->alloc, p);
 }
 
 /* unsigned itoa with an optional padding */
@@ -317,134 +230,361 @@ static char *slog_itoa_pad (char *buf, unsigned n, unsigned pad) {
     return buf;
 }
 
-char *slog_vfmt_get_str (const slog_loglevel *level, slog_fmt *fmt, const char *mfmt, va_list *va) {
-    char buf[48],
-         *ptr;
+/* size of the longest date/time token (%c) */
+#define SLOG_TCACHE_STRSIZ 32
+
+/* Date and time tokens only change once a second, so each thread keeps
+ * them rendered for the current second and copies them from here.
+ * localtime_r () (which locks and reads the TZ state) runs once per second
+ * and a token is converted to text on its first use within the second. */
+typedef struct slog_tcache {
+    time_t sec;
+    struct tm tm;
+    /* a bit per token, which is rendered for `sec` */
+    unsigned int valid;
+    unsigned char len[slog_token_count];
+    char str[slog_token_count][SLOG_TCACHE_STRSIZ];
+} slog_tcache;
+
+static _Thread_local slog_tcache slog_tcache_ = { .sec = (time_t)-1 };
+
+static slog_tcache *_tcache_get (time_t ep) {
+    slog_tcache *tc = &slog_tcache_;
+
+    if (ep != tc->sec) {
+        localtime_r (&ep, &tc->tm);
+        tc->sec   = ep;
+        tc->valid = 0;
+    }
+    return tc;
+}
 
-    char *_str = slog_xalloc (SLOG_BUFSIZ);
-#   define _realloc_to_fill(need) {           \
-        bufsiz = bufsiz + need / SLOG_BUFSIZ; \
-        _str = slog_realloc (_str, bufsiz);   \
+/* get the text of a date/time token for the current second */
+static const char *_tcache_token (slog_tcache *tc, slog_token token, size_t *len) {
+    char *buf = tc->str[token];
+    const struct tm *c_time = &tc->tm;
+
+    if (tc->valid & (1u << token)) {
+        *len = tc->len[token];
+        return buf;
     }
 
-    /* if message is required twice or more times for some reason */
-    const char *msg_ptr = va ? NULL : mfmt;
-    size_t msg_size     = 0;
-    
-    size_t written = 0,
-           bufsiz  = SLOG_BUFSIZ;
+    switch (token) {
+        case slog_token_hour12:
+            slog_itoa_pad (buf, c_time->tm_hour % 12 ? c_time->tm_hour % 12 : 12, 2);
+            break;
+        case slog_token_hour24:
+            slog_itoa_pad (buf, c_time->tm_hour, 2);
+            break;
+        case slog_token_minutes:
+            slog_itoa_pad (buf, c_time->tm_min, 2);
+            break;
+        case slog_token_seconds:
+            slog_itoa_pad (buf, c_time->tm_sec, 2);
+            break;
+        case slog_token_day:
+            slog_itoa_pad (buf, c_time->tm_mday, 2);
+            break;
+        case slog_token_month:
+            slog_itoa_pad (buf, c_time->tm_mon + 1, 2);
+            break;
+        case slog_token_year2:
+            slog_itoa_pad (buf, (SLOG_BASE_YEAR + c_time->tm_year) % 100, 2);
+            break;
+        case slog_token_year4:
+            slog_itoa_pad (buf, SLOG_BASE_YEAR + c_time->tm_year, 0);
+            break;
+        case slog_token_timestamp:
+            /* eventually, this will overflow. Fortunately enough it will only
+             * happen in 2038. */
+            slog_itoa_pad (buf, (int)tc->sec, 0);
+            break;
+        case slog_token_rfc3339: {
+            /* the fraction and the zone follow */
+            char *p = buf;
+            slog_itoa_pad (p, SLOG_BASE_YEAR + c_time->tm_year, 4);
+            p += strlen (p);
+            *p++ = '-';
+            slog_itoa_pad (p, c_time->tm_mon + 1, 2);
+            p += 2;
+            *p++ = '-';
+            slog_itoa_pad (p, c_time->tm_mday, 2);
+            p += 2;
+            *p++ = 'T';
+            slog_itoa_pad (p, c_time->tm_hour, 2);
+            p += 2;
+            *p++ = ':';
+            slog_itoa_pad (p, c_time->tm_min, 2);
+            p += 2;
+            *p++ = ':';
+            slog_itoa_pad (p, c_time->tm_sec, 2);
+            break;
+        }
+        case slog_token_zone: {
+            long off = c_time->tm_gmtoff / 60;
+            if (!off) {
+                strcpy (buf, "Z");
+                break;
+            }
+            buf[0] = off < 0 ? '-' : '+';
+            if (off < 0)
+                off = -off;
+            slog_itoa_pad (buf + 1, off / 60, 2);
+            buf[3] = ':';
+            slog_itoa_pad (buf + 4, off % 60, 2);
+            break;
+        }
+        case slog_token_ctime: {
+            char tmp[48];
+            asctime_r (c_time, tmp);
+            /* AFAIK windows manages strings in mysterious ways */
+            size_t n = strcspn (tmp, "\r\n");
+            if (n >= SLOG_TCACHE_STRSIZ)
+                n = SLOG_TCACHE_STRSIZ - 1;
+            memcpy (buf, tmp, n);
+            buf[n] = 0x0;
+            break;
+        }
+        default:
+            buf[0] = 0x0;
+            break;
+    }
 
-    slog_fmt_tok *tok = fmt->fmt_tok_head;
-    slog_fmt_str *str = fmt->fmt_str_head;
+    tc->len[token] = strlen (buf);
+    tc->valid |= 1u << token;
+    *len = tc->len[token];
+    return buf;
+}
 
-    time_t ep;
-    time (&ep);
+/* append the RFC 3339 time of an entry */
+static void _fmt_rfc3339 (slog_buf *out, slog_tcache *tc, const struct timespec *ts) {
+    char buf[8];
+    size_t len;
+    const char *p = _tcache_token (tc, slog_token_rfc3339, &len);
+    slog_buf_append (out, p, len);
+    buf[0] = '.';
+    slog_itoa_pad (buf + 1, ts->tv_nsec / 1000, 6);
+    slog_buf_append (out, buf, 7);
+    p = _tcache_token (tc, slog_token_zone, &len);
+    slog_buf_append (out, p, len);
+}
+
+/* append the message of an entry as is */
+static void _fmt_message (slog_buf *out, const slog_entry *e) {
+    if (e->render)
+        e->render (out, e->ctx);
+    else if (e->list)
+        slog_buf_vprintf (out, e->mfmt, e->list);
+    else
+        slog_buf_append (out, e->mfmt, strlen (e->mfmt));
+}
+
+/* append an entry as a JSON object or a logfmt line */
+static void _fmt_record (slog_buf *out, slog_tcache *tc, const struct timespec *ts,
+        const slog_entry *e, slog_kv_style style) {
+    const char *level = e->level->prefix;
+    if (style == slog_kv_json) {
+        slog_buf_append (out, "{\"time\":\"", 9);
+        _fmt_rfc3339 (out, tc, ts);
+        slog_buf_append (out, "\",\"level\":", 10);
+    } else {
+        slog_buf_append (out, "time=", 5);
+        _fmt_rfc3339 (out, tc, ts);
+        slog_buf_append (out, " level=", 7);
+    }
+    slog_kv_string (out, level, strlen (level), style);
+    slog_buf_append (out, style == slog_kv_json ? ",\"msg\":" : " msg=", style == slog_kv_json ? 7 : 5);
+
+    /* a formatted message is escaped from the scratch buffer */
+    if (e->list || e->render) {
+        slog_buf *msg = slog_buf_thread_at (SLOG_BUF_SCRATCH);
+        if (msg) {
+            _fmt_message (msg, e);
+            slog_kv_string (out, msg->data, msg->failed ? 0 : msg->len, style);
+            slog_buf_release (msg);
+        } else {
+            out->failed = 1;
+        }
+    } else {
+        slog_kv_string (out, e->mfmt, strlen (e->mfmt), style);
+    }
+
+    if (e->kv)
+        slog_kv_fields (out, e->kv, style);
+    if (style == slog_kv_json)
+        slog_buf_append (out, "}", 1);
+}
+
+/* the file name of a call site without the directories, only looked
+ * for once if the compiler has not provided it */
+static const char *_site_base (slog_site *site, size_t *len) {
+    const char *base = __atomic_load_n (&site->base, __ATOMIC_ACQUIRE);
+    if (!base) {
+        base = strrchr (site->file, '/');
+        base = base ? base + 1 : site->file;
+        /* the length is published before the name, which announces it */
+        *len = strlen (base);
+        __atomic_store_n (&site->base_len, (unsigned int)*len, __ATOMIC_RELAXED);
+        __atomic_store_n (&site->base, base, __ATOMIC_RELEASE);
+        return base;
+    }
+    *len = __atomic_load_n (&site->base_len, __ATOMIC_RELAXED);
+    return base;
+}
 
-    struct tm *c_time;
-    c_time = localtime (&ep);
+char slog_fmt_entry (slog_buf *out, slog_fmt *fmt, const slog_entry *e) {
+    char buf[48],
+         *ptr;
 
-    while (tok) {
-        switch (tok->token) {
+    /* if message is required twice or more times for some reason,
+     * it is copied from its first occurrence in the output */
+    size_t msg_off  = 0,
+           msg_size = 0;
+    slog_bool has_msg = slog_false;
+
+    const slog_fmt_op *op  = fmt->ops,
+                      *end = fmt->ops + fmt->nops;
+
+    /* a single clock read serves every time token */
+    struct timespec ts = e->ts;
+    if (!e->has_time)
+        slog_clock_now (&ts);
+    slog_tcache *tc = _tcache_get (ts.tv_sec);
+    size_t plen = 0;
+    long long ns;
+
+    for (; op < end; ++op) {
+        ptr = NULL;
+        switch (op->token) {
             case slog_token_none:
                 break;
             case slog_token_level:
-                ptr = (char *)level->prefix;
-                break;
-            case slog_token_hour12: {
-                char _b;
-                ptr = slog_itoa_pad (buf, (_b = c_time->tm_hour % 12) != 0 ? _b : 1, 2);
-                break;
-            }
-            case slog_token_hour24:
-                ptr = slog_itoa_pad (buf, c_time->tm_hour, 2);
-                break;
-            case slog_token_minutes:
-                ptr = slog_itoa_pad (buf, c_time->tm_min, 2);
-                break;
-            case slog_token_seconds:
-                ptr = slog_itoa_pad (buf, c_time->tm_sec, 2);
+                ptr = (char *)e->level->prefix;
+                plen = strlen (ptr);
                 break;
             case slog_token_literal:
-                ptr = (char *)str->str;
-                str = str->next;
+                ptr = &fmt->lits[op->off];
+                plen = op->len;
                 break;
             case slog_token_message:
-                if (!msg_ptr) {
-                    va_list vac;
-                    va_copy (vac, *va);
-                    msg_size = vsnprintf (&_str[written], 0, mfmt, vac);
-                    va_end (vac);
-
-                    if (msg_size + 1 >= bufsiz - written) {
-                        _realloc_to_fill (msg_size + 1);
+                if (has_msg) {
+                    /* the first copy may have been truncated */
+                    if (msg_off + msg_size < out->size) {
+                        slog_buf_reserve (out, msg_size);
+                        slog_buf_append (out, &out->data[msg_off], msg_size);
+                    } else {
+                        out->len += msg_size;
                     }
-
-                    (void)vsnprintf (&_str[written], msg_size + 1, mfmt, *va);
-                    msg_ptr = &_str[written];
-                    written += msg_size;
-
-                    ptr = NULL;
-                } else {
-                    ptr = (char *)msg_ptr;
+                    break;
                 }
+                msg_off = out->len;
+                _fmt_message (out, e);
+                /* the fields of a structured entry follow the message */
+                if (e->kv)
+                    slog_kv_fields (out, e->kv, slog_kv_logfmt);
+                msg_size = out->len - msg_off;
+                has_msg  = slog_true;
                 break;
-            case slog_token_day:
-                ptr = slog_itoa_pad (buf, c_time->tm_mday, 2);
+            case slog_token_runtime:
+                ptr = slog_itoa_pad (buf, (long long)(clock () / CLOCKS_PER_SEC), 0);
+                plen = strlen (ptr);
                 break;
-            case slog_token_month:
-                ptr = slog_itoa_pad (buf, c_time->tm_mon + 1, 2);
+            case slog_token_msec:
+                ptr  = slog_itoa_pad (buf, ts.tv_nsec / 1000000, 3);
+                plen = 3;
                 break;
-            case slog_token_year2:
-                ptr = slog_itoa_pad (buf, (SLOG_BASE_YEAR + c_time->tm_year) % 100, 2);
+            case slog_token_usec:
+                ptr  = slog_itoa_pad (buf, ts.tv_nsec / 1000, 6);
+                plen = 6;
                 break;
-            case slog_token_year4:
-                ptr = slog_itoa_pad (buf, SLOG_BASE_YEAR + c_time->tm_year, 0);
+            case slog_token_nsec:
+                ptr  = slog_itoa_pad (buf, ts.tv_nsec, 9);
+                plen = 9;
                 break;
-            case slog_token_space:
-                ptr = " ";
+            case slog_token_rfc3339:
+                _fmt_rfc3339 (out, tc, &ts);
                 break;
-            case slog_token_runtime:
-                ptr = slog_itoa_pad (buf, (long long)(clock () / CLOCKS_PER_SEC), 0);
+            case slog_token_json:
+                _fmt_record (out, tc, &ts, e, slog_kv_json);
                 break;
-            case slog_token_timestamp:
-                /* eventually, this will overflow. Fortunately enough it will only
-                 * happen in 2038. */
-                ptr = slog_itoa_pad (buf, (int)ep, 0);
+            case slog_token_logfmt:
+                _fmt_record (out, tc, &ts, e, slog_kv_logfmt);
                 break;
-            case slog_token_ctime:
-                strncpy (buf, asctime (c_time), 48);
-                {
-                    /* AFAIK windows manages strings in mysterious ways */
-                    char *nlp = strchr (buf, '\r');
-                    if (!nlp)
-                        nlp = strchr (buf, '\n');
-                    if (nlp)
-                        *nlp = 0x0;
+            case slog_token_elapsed:
+                /* seconds with microseconds */
+                ns  = e->has_elapsed ? e->elapsed : slog_clock_elapsed ();
+                ptr = slog_itoa_pad (buf, ns / 1000000000, 0);
+                plen = strlen (ptr);
+                buf[plen++] = '.';
+                slog_itoa_pad (buf + plen, ns % 1000000000 / 1000, 6);
+                plen += 6;
+                break;
+            case slog_token_file:
+                if (e->site)
+                    ptr = (char *)_site_base (e->site, &plen);
+                break;
+            case slog_token_line:
+                if (e->site) {
+                    ptr  = slog_itoa_pad (buf, e->site->line, 0);
+                    plen = strlen (ptr);
                 }
-                ptr = buf;
+                break;
+            case slog_token_func:
+                if (e->site) {
+                    ptr  = (char *)e->site->func;
+                    plen = e->site->func_len;
+                }
+                break;
+            case slog_token_ctime:
+            case slog_token_hour12:
+            case slog_token_hour24:
+            case slog_token_minutes:
+            case slog_token_seconds:
+            case slog_token_day:
+            case slog_token_month:
+            case slog_token_year2:
+            case slog_token_year4:
+            case slog_token_timestamp:
+                ptr = (char *)_tcache_token (tc, op->token, &plen);
                 break;
             default:
                 break;
         }
 
-        if (ptr) {
-            size_t tsiz = strlen (ptr);
-            if (written + tsiz >= bufsiz) {
-                _realloc_to_fill (written + tsiz);
-            }
-            memcpy (&_str[written], ptr, tsiz);
-            written += tsiz;
-        }
-
-        tok = tok->next;
+        if (ptr)
+            slog_buf_append (out, ptr, plen);
     }
 
-    _str[written] = 0x0;
+    slog_buf_terminate (out);
+    return out->failed;
+}
+
+char *slog_vfmt_get_str (const slog_loglevel *level, slog_fmt *fmt, const char *mfmt, va_list *va) {
+    slog_entry e = { level, mfmt, va };
+    slog_buf out;
+    if (slog_buf_init (&out, NULL, SLOG_BUFSIZ) != 0)
+        return NULL;
 
-    return _str;
+    if (slog_fmt_entry (&out, fmt, &e) != 0) {
+        slog_free (out.data);
+        return NULL;
+    }
+    return out.data;
 }
 
 /* compatibility with older versions */
 char *slog_fmt_get_str (const slog_loglevel *level, slog_fmt *fmt, const char *message) {
     return slog_vfmt_get_str (level, fmt, message, NULL);
 }
+
+size_t slog_vfmt_write (const slog_loglevel *level, slog_fmt *fmt, char *buf, size_t size, const char *mfmt, va_list *va) {
+    /* a fixed buffer, NULL only measures the entry */
+    slog_buf out = { buf, 0, buf ? size : 0, 1, 0 };
+    slog_entry e = { level, mfmt, va };
+    (void)slog_fmt_entry (&out, fmt, &e);
+    return out.len;
+}
+
+size_t slog_fmt_write (const slog_loglevel *level, slog_fmt *fmt, char *buf, size_t size, const char *message) {
+    return slog_vfmt_write (level, fmt, buf, size, message, NULL);
+}
@@ -14,26 +14,38 @@ extern "C" {
 #include <stddef.h>
 #include <stdarg.h>
 
+#include "slog_alloc.h"
 #include "slog_export.h"
 #include "slog_loglevel.h"
 
+/* an instruction of the compiled format: a token or a run of literals */
+typedef struct slog_fmt_op slog_fmt_op;
+
+/* a format compiled into a flat array of ops, the ops, the literal
+ * pool and the structure itself are a single allocation */
 typedef struct slog_fmt {
-    struct slog_fmt_tok *fmt_tok_head;
-    struct slog_fmt_str *fmt_str_head;
+    slog_fmt_op *ops;
+    size_t nops;
+    /* all literals of the format, the ops refer to them by offset */
+    char *lits;
+    /* the allocator of the block, NULL for the global one */
+    const slog_allocator *alloc;
 } slog_fmt;
 
-/* a structure which contains a stream of tokens */
-typedef struct slog_fmt_tok slog_fmt_tok;
-/* a structure which is tied to slog_fmt, contains 
- * a stream of literals, to which tokens may refer */
-typedef struct slog_fmt_str slog_fmt_str;
-
 /* slog_fmt_create - create an slog_fmt structure
  * @param str
  *   string for the format 
  * @return
  *   a valid pointer to the slog_fmt structure, NULL otherwise */
 SLOG_API slog_fmt *slog_fmt_create  (const char *str);
+/* slog_fmt_create_with - create an slog_fmt structure with an allocator
+ * @param str
+ *   string for the format
+ * @param alloc
+ *   the allocator, it must outlive the format, NULL for the global one
+ * @return
+ *   a valid pointer to the slog_fmt structure, NULL otherwise */
+SLOG_API slog_fmt *slog_fmt_create_with (const char *str, const slog_allocator *alloc);
 /* slog_fmt_get_str - get the string, formed with a slog_fmt
  * @param level
  *   loglevel of a log entry
@@ -59,6 +71,44 @@ SLOG_API char *slog_fmt_get_str (const slog_loglevel *level, slog_fmt *fmt, cons
  *   valid pointer to a string, NULL otherwise */
 SLOG_API char *slog_vfmt_get_str (const slog_loglevel *level, slog_fmt *fmt, const char *mfmt, va_list *list);
 
+/* slog_fmt_write - write the string, formed with a slog_fmt, to a caller
+ * supplied buffer without allocating memory
+ * @param level
+ *   loglevel of a log entry
+ * @param fmt
+ *   format to be used on the string
+ * @param buf
+ *   destination buffer, can be NULL if size is 0
+ * @param size
+ *   size of the destination buffer
+ * @param message
+ *   message of the log entry
+ * @return
+ *   length of the entry (without the terminating NUL), if it is not
+ *   less than size, the output was truncated (as in snprintf ()) */
+SLOG_API size_t slog_fmt_write (const slog_loglevel *level, slog_fmt *fmt, char *buf, size_t size, const char *message);
+/* slog_vfmt_write - write the string, formed with a slog_fmt, to a caller
+ * supplied buffer without allocating memory
+ * @param level
+ *   loglevel of a log entry
+ * @param fmt
+ *   format to be used on the string
+ * @param buf
+ *   destination buffer, can be NULL if size is 0
+ * @param size
+ *   size of the destination buffer
+ * @param mfmt
+ *   message format (as in token %L)
+ * @param list
+ *   vararg list pointer for mfmt
+ * @return
+ *   length of the entry (without the terminating NUL), if it is not
+ *   less than size, the output was truncated (as in snprintf ()) */
+SLOG_API size_t slog_vfmt_write (const slog_loglevel *level, slog_fmt *fmt, char *buf, size_t size, const char *mfmt, va_list *list);
+
+/* slog_fmt_clear - free an slog_fmt structure
+ * @param p
+ *   pointer to the slog_fmt structure */
 SLOG_API void slog_fmt_clear (slog_fmt *p);
 
 #ifdef __cplusplus
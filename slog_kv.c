@@ -0,0 +1,175 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+#include "slog.h"
+#include "slog_kv.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char slog_kv_hex_[] = "0123456789abcdef";
+
+/* the escape sequence of a character, NULL if it is written as is */
+static const char *_kv_escape (unsigned char c, char *tmp, size_t *len) {
+    *len = 2;
+    switch (c) {
+        case '"':  return "\\\"";
+        case '\\': return "\\\\";
+        case '\n': return "\\n";
+        case '\r': return "\\r";
+        case '\t': return "\\t";
+        default:
+            break;
+    }
+    if (c >= 0x20)
+        return NULL;
+
+    memcpy (tmp, "\\u00", 4);
+    tmp[4] = slog_kv_hex_[c >> 4];
+    tmp[5] = slog_kv_hex_[c & 0xf];
+    *len = 6;
+    return tmp;
+}
+
+/* logfmt values with spaces, quotes or '=' must be quoted */
+static int _kv_needs_quotes (const char *s, size_t n) {
+    size_t i;
+    if (!n)
+        return 1;
+    for (i = 0; i < n; ++i)
+        if ((unsigned char)s[i] <= ' ' || s[i] == '"' || s[i] == '=' || s[i] == '\\')
+            return 1;
+    return 0;
+}
+
+void slog_kv_string (slog_buf *out, const char *s, size_t n, slog_kv_style style) {
+    if (!s) {
+        if (style == slog_kv_json)
+            slog_buf_append (out, "null", 4);
+        else
+            slog_buf_append (out, "\"\"", 2);
+        return;
+    }
+    if (style == slog_kv_logfmt && !_kv_needs_quotes (s, n)) {
+        slog_buf_append (out, s, n);
+        return;
+    }
+
+    /* copy the runs between the escaped characters */
+    const char *run = s, *end = s + n, *p;
+    char tmp[8];
+    size_t len;
+    slog_buf_append (out, "\"", 1);
+    for (p = s; p < end; ++p) {
+        const char *esc = _kv_escape ((unsigned char)*p, tmp, &len);
+        if (!esc)
+            continue;
+        slog_buf_append (out, run, p - run);
+        slog_buf_append (out, esc, len);
+        run = p + 1;
+    }
+    slog_buf_append (out, run, end - run);
+    slog_buf_append (out, "\"", 1);
+}
+
+/* logfmt keys cannot be quoted: the characters, which would end the key,
+ * are written as '_' and an empty key as a single '_' */
+static void _kv_key (slog_buf *out, const char *s, size_t n) {
+    const char *run = s, *end = s + n, *p;
+    if (!n) {
+        slog_buf_append (out, "_", 1);
+        return;
+    }
+    for (p = s; p < end; ++p) {
+        if ((unsigned char)*p > ' ' && *p != '"' && *p != '=' && *p != '\\')
+            continue;
+        slog_buf_append (out, run, p - run);
+        slog_buf_append (out, "_", 1);
+        run = p + 1;
+    }
+    slog_buf_append (out, run, end - run);
+}
+
+static void _kv_ulltoa (slog_buf *out, unsigned long long v, int neg) {
+    char buf[24], *p = buf + sizeof (buf);
+    do {
+        *--p = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    if (neg)
+        *--p = '-';
+    slog_buf_append (out, p, buf + sizeof (buf) - p);
+}
+
+static void _kv_double (slog_buf *out, double v, slog_kv_style style) {
+    if (!isfinite (v)) {
+        if (style == slog_kv_json)
+            slog_buf_append (out, "null", 4);
+        else if (isnan (v))
+            slog_buf_append (out, "NaN", 3);
+        else
+            slog_buf_append (out, v < 0 ? "-Inf" : "+Inf", 4);
+        return;
+    }
+    /* the shorter form, unless it does not read back as the same value */
+    char buf[32];
+    int n = snprintf (buf, sizeof (buf), "%.15g", v);
+    if (strtod (buf, NULL) != v)
+        n = snprintf (buf, sizeof (buf), "%.17g", v);
+    if (n > 0)
+        slog_buf_append (out, buf, n);
+}
+
+void slog_kv_fields (slog_buf *out, va_list *kv, slog_kv_style style) {
+    va_list list;
+    va_copy (list, *kv);
+
+    const char *key;
+    while ((key = va_arg (list, const char *)) != NULL) {
+        if (style == slog_kv_json) {
+            slog_buf_append (out, ",", 1);
+            slog_kv_string (out, key, strlen (key), slog_kv_json);
+            slog_buf_append (out, ":", 1);
+        } else {
+            slog_buf_append (out, " ", 1);
+            _kv_key (out, key, strlen (key));
+            slog_buf_append (out, "=", 1);
+        }
+
+        switch ((slog_kv_type)va_arg (list, int)) {
+            case slog_kv_str: {
+                const char *s = va_arg (list, const char *);
+                slog_kv_string (out, s, s ? strlen (s) : 0, style);
+                break;
+            }
+            case slog_kv_int: {
+                long long v = va_arg (list, long long);
+                _kv_ulltoa (out, v < 0 ? -(unsigned long long)v : (unsigned long long)v, v < 0);
+                break;
+            }
+            case slog_kv_uint:
+                _kv_ulltoa (out, va_arg (list, unsigned long long), 0);
+                break;
+            case slog_kv_double:
+                _kv_double (out, va_arg (list, double), style);
+                break;
+            case slog_kv_bool:
+                if (va_arg (list, int))
+                    slog_buf_append (out, "true", 4);
+                else
+                    slog_buf_append (out, "false", 5);
+                break;
+            default:
+                /* the rest of the list cannot be interpreted */
+                slog_buf_append (out, "null", 4);
+                va_end (list);
+                return;
+        }
+    }
+    va_end (list);
+}
@@ -0,0 +1,43 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+#ifndef __SLOG_KV_H__
+#define __SLOG_KV_H__
+
+/* Encoders of the structured entries (see: slog_kv ()), used by the
+ * format tokens %J (JSON lines), %K (logfmt) and %L (the message
+ * followed by the fields in logfmt). */
+
+#include "slog_export.h"
+#include "slog_buf.h"
+#include <stdarg.h>
+
+typedef enum slog_kv_style {
+    slog_kv_json,
+    slog_kv_logfmt
+} slog_kv_style;
+
+/* slog_kv_string - append a string value, quoted and escaped as the style
+ * requires (logfmt values without special characters are not quoted)
+ * @param out
+ *   output buffer
+ * @param s
+ *   the string, NULL is encoded as null (JSON) or an empty string
+ * @param n
+ *   length of the string
+ * @param style
+ *   encoding */
+SLOG_API void slog_kv_string (slog_buf *out, const char *s, size_t n, slog_kv_style style);
+/* slog_kv_fields - append the fields of a structured entry, each preceded
+ * by a comma (JSON) or a space (logfmt)
+ * @param out
+ *   output buffer
+ * @param kv
+ *   the fields: key, slog_kv_type, value, ..., NULL (see: slog_kv ()),
+ *   the list is not consumed */
+SLOG_API void slog_kv_fields (slog_buf *out, va_list *kv, slog_kv_style style);
+
+#endif
@@ -0,0 +1,150 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+/* Rate limiting of a call site. The check is done before the message is
+ * formatted and costs at most one atomic operation on the state of the site:
+ *   rate   - the token bucket is kept as a single "theoretical arrival time"
+ *            (GCRA), an entry passes if it is not too far in the future and
+ *            is moved forward by 1/n s with a compare-and-swap;
+ *   every  - a counter, every n-th occurrence passes;
+ *   sample - a thread-local xorshift generator, the state is not touched.
+ * The occurrences, which did not pass, are counted with an atomic add on
+ * the shared `dropped` of the site (a thread-local count could outlive the
+ * limit it belongs to), and the count is reported by the next entry, which
+ * passes. */
+
+#include "slog.h"
+#include "slog_buf.h"
+#include "slog_clock.h"
+#include "slog_log.h"
+#include "slog_mem.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+/* the state of the sampling generator, seeded on the first use */
+static _Thread_local uint64_t slog_limit_rng_;
+
+static uint32_t _limit_random (void) {
+    uint64_t x = slog_limit_rng_;
+    if (!x)
+        x = (uint64_t)(uintptr_t)&slog_limit_rng_ ^ (uint64_t)slog_clock_elapsed () ^ 0x9e3779b97f4a7c15ull;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    slog_limit_rng_ = x;
+    return (uint32_t)(x >> 32);
+}
+
+static int _limit_rate (slog_limit *limit) {
+    unsigned long long interval = 1000000000ull / limit->n;
+    /* up to n entries in a burst */
+    unsigned long long burst = interval * (limit->n - 1);
+    unsigned long long now = (unsigned long long)slog_clock_elapsed ();
+    unsigned long long tat = __atomic_load_n (&limit->state, __ATOMIC_RELAXED);
+
+    for (;;) {
+        unsigned long long t = tat > now ? tat : now;
+        if (t - now > burst)
+            return 0;
+        if (__atomic_compare_exchange_n (&limit->state, &tat, t + interval, 1,
+                    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            return 1;
+    }
+}
+
+int slog_limit_pass (slog_limit *limit, unsigned long long *dropped) {
+    assert (limit != NULL);
+
+    int pass;
+    switch (limit->kind) {
+        case slog_limit_rate:
+            pass = !limit->n || _limit_rate (limit);
+            break;
+        case slog_limit_every:
+            pass = !limit->n || __atomic_fetch_add (&limit->state, 1, __ATOMIC_RELAXED) % limit->n == 0;
+            break;
+        case slog_limit_sample:
+            /* a zero n is the probability 0, not a disabled limit */
+            pass = limit->n == UINT32_MAX || _limit_random () < limit->n;
+            break;
+        default:
+            pass = 1;
+            break;
+    }
+
+    if (!pass) {
+        __atomic_fetch_add (&limit->dropped, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    if (dropped)
+        *dropped = __atomic_load_n (&limit->dropped, __ATOMIC_RELAXED)
+            ? __atomic_exchange_n (&limit->dropped, 0, __ATOMIC_RELAXED) : 0;
+    return 1;
+}
+
+/* print a message, which passed the limit */
+static void _limit_vprintf (slog_stream *stream, const slog_loglevel *level,
+        unsigned long long dropped, const char *fmt, va_list list) {
+    if (!dropped) {
+        slog_vprintf (stream, level, fmt, list);
+        return;
+    }
+
+    /* rarely taken, the thread's buffers are used by slog_puts () */
+    slog_buf msg;
+    if (slog_buf_init (&msg, NULL, SLOG_BUFSIZ) != 0) {
+        slog_log_error ("Failed to get a formatted string");
+        return;
+    }
+    va_list vac;
+    va_copy (vac, list);
+    slog_buf_vprintf (&msg, fmt, &vac);
+    va_end (vac);
+
+    char suffix[48];
+    int n = snprintf (suffix, sizeof (suffix), " [%llu dropped]", dropped);
+    slog_buf_append (&msg, suffix, n);
+    slog_buf_terminate (&msg);
+    if (!msg.failed)
+        slog_puts (stream, level, msg.data);
+    else
+        slog_log_error ("Failed to get a formatted string");
+    slog_free (msg.data);
+}
+
+void slog_printf_limited (slog_stream *stream, slog_limit *limit, const slog_loglevel *level,
+        const char *fmt, ...) {
+    va_list list;
+    va_start (list, fmt);
+    slog_vprintf_limited (stream, limit, level, fmt, list);
+    va_end (list);
+}
+
+void slog_vprintf_limited (slog_stream *stream, slog_limit *limit, const slog_loglevel *level,
+        const char *fmt, va_list list) {
+    assert (stream != NULL);
+    assert (fmt != NULL);
+
+    /* a suppressed level does not use up the limit */
+    if (!slog_enabled (stream, level))
+        return;
+
+    unsigned long long dropped;
+    if (slog_limit_pass (limit, &dropped))
+        _limit_vprintf (stream, level, dropped, fmt, list);
+}
+
+void slog_printf_dropped (slog_stream *stream, const slog_loglevel *level,
+        unsigned long long dropped, const char *fmt, ...) {
+    assert (stream != NULL);
+    assert (fmt != NULL);
+
+    va_list list;
+    va_start (list, fmt);
+    _limit_vprintf (stream, level, dropped, fmt, list);
+    va_end (list);
+}
@@ -5,15 +5,43 @@
  * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
 
 #include "slog_loglevel.h"
-#include <limits.h>
+#include "slog_log.h"
 
-static unsigned int slog_lastuuid_ = (1 << 5);
+#include <stdatomic.h>
 
-void slog_newloglevel (slog_loglevel *level, const char *prefix, slog_color color, unsigned char suppress) {
+/* the next free index, the built-in levels take 1 to 5 */
+static atomic_uint slog_level_next_ = 6;
+/* the registered levels by their index */
+static _Atomic (const slog_loglevel *) slog_levels_[SLOG_LEVELS_MAX] = {
+    NULL,
+    &slog_loglevel_message_s,
+    &slog_loglevel_warning_s,
+    &slog_loglevel_error_s,
+    &slog_loglevel_debug_s,
+    &slog_loglevel_fatal_s
+};
+
+char slog_newloglevel (slog_loglevel *level, const char *prefix, slog_color color, unsigned char suppress) {
     level->prefix = prefix;
     level->color  = color;
     level->unsuppressible = !suppress;
 
-    level->id = slog_lastuuid_;
-    slog_lastuuid_ <<= 1;
+    unsigned int i = atomic_fetch_add_explicit (&slog_level_next_, 1, memory_order_relaxed);
+    if (i >= SLOG_LEVELS_MAX) {
+        /* index 0 is never suppressed */
+        level->index = 0;
+        level->id    = 0;
+        slog_log_error ("Too many loglevels, \"%s\" cannot be suppressed", prefix);
+        return 1;
+    }
+    level->index = i;
+    level->id    = i < 32 ? 1u << i : 0;
+    atomic_store_explicit (&slog_levels_[i], level, memory_order_release);
+    return 0;
+}
+
+const slog_loglevel *slog_loglevel_get (unsigned int index) {
+    if (index >= SLOG_LEVELS_MAX)
+        return NULL;
+    return atomic_load_explicit (&slog_levels_[index], memory_order_acquire);
 }
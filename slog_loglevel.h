@@ -12,6 +12,14 @@
 
 #define SLOG_SUPPRESS_NOTHING 0
 
+/* maximal number of loglevels, the built-in ones included */
+#define SLOG_LEVELS_MAX 256
+/* size of a suppression bitset of all the loglevels in words */
+#define SLOG_LEVEL_WORDS (SLOG_LEVELS_MAX / 32)
+/* the word and the bit of a loglevel in a suppression bitset */
+#define slog_level_word(level) ((level)->index >> 5)
+#define slog_level_bit(level)  (1u << ((level)->index & 31))
+
 /* typedef enum slog_loglevel { */
 /*     slog_loglevel_message = 1, */
 /*     slog_loglevel_warning = (1 << 1), */
@@ -29,9 +37,12 @@ typedef struct slog_loglevel {
     
     /* if the message can be suppressed */
     unsigned char unsuppressible;
-    /* unique identifier of the loglevel 
-     * (should be a power of 2) */
+    /* unique identifier of the loglevel, 1 << index for the first
+     * 32 loglevels, 0 for the others, which cannot be part of a mask */
     unsigned int  id;
+    /* dense index of the loglevel, its bit in the suppression bitsets,
+     * 0 for a level, which is not registered */
+    unsigned int  index;
 } slog_loglevel;
 
 static const slog_loglevel slog_loglevel_message_s = {
@@ -39,30 +50,35 @@ static const slog_loglevel slog_loglevel_message_s = {
     .color = slog_color_message,
     .unsuppressible = 0,
     .id = (1 << 1),
+    .index = 1
 };
 static const slog_loglevel slog_loglevel_warning_s = {
     .prefix = "Warning",
     .color = slog_color_warning,
     .unsuppressible = 0,
-    .id = (1 << 2)
+    .id = (1 << 2),
+    .index = 2
 };
 static const slog_loglevel slog_loglevel_error_s = {
     .prefix = "Error",
     .color = slog_color_error,
     .unsuppressible = 0,
-    .id = (1 << 3)
+    .id = (1 << 3),
+    .index = 3
 };
 static const slog_loglevel slog_loglevel_debug_s = {
     .prefix = "Debug",
     .color = slog_color_warning,
     .unsuppressible = 0,
-    .id = (1 << 4)
+    .id = (1 << 4),
+    .index = 4
 };
 static const slog_loglevel slog_loglevel_fatal_s = {
     .prefix = "Fatal",
     .color = slog_color_fatal,
     .unsuppressible = 0,
-    .id = (1 << 5)
+    .id = (1 << 5),
+    .index = 5
 };
 
 #define slog_loglevel_message &slog_loglevel_message_s
@@ -79,16 +95,27 @@ static const slog_loglevel *slog_loglevels[] = {
     slog_loglevel_fatal
 };
 
-/* slog_newloglevel - create and register a new log level
+/* slog_newloglevel - create and register a new log level, which gets
+ * the next free index (thread safe)
  * @param level
- *   buffer, where the level information is dumped
+ *   buffer, where the level information is dumped, it must stay valid
+ *   while the level is in use
  * @param color
  *   color of the messages with this log level
  * @param suppress
  *   can the loglevel be suppressed?
+ * @return
+ *   0 on success, non-zero if SLOG_LEVELS_MAX levels already exist (the
+ *   level is still usable, but cannot be suppressed)
  * @note
- *   this function is thread unsafe as it reads and writes
- *   to a static variable */
-SLOG_API void slog_newloglevel (slog_loglevel *level, const char *prefix, slog_color color, unsigned char suppress);
+ *   only the first 32 loglevels have an id for the suppression masks,
+ *   the others are suppressed with slog_suppress_level () */
+SLOG_API char slog_newloglevel (slog_loglevel *level, const char *prefix, slog_color color, unsigned char suppress);
+/* slog_loglevel_get - look up a registered loglevel
+ * @param index
+ *   index of the loglevel
+ * @return
+ *   pointer to the loglevel, NULL if there is none with the index */
+SLOG_API const slog_loglevel *slog_loglevel_get (unsigned int index);
 
 #endif
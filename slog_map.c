@@ -0,0 +1,98 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+/* Memory-mapped output: the file is allocated SLOG_MAP_CHUNK bytes at
+ * a time and a window of it is mapped, an entry is just copied into the
+ * window. Once an entry does not fit, the window is moved forward (and
+ * the file grown). The file is truncated to the written length when it
+ * is closed or switched by a rotation. */
+
+#include "slog_stream.h"
+#include "slog_log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* map the window, which holds the next `len` bytes */
+static char _map_window (slog_stream *stream, size_t len) {
+    slog_map *m = &stream->map;
+    int fd = fileno (stream->file);
+
+    if (!m->active) {
+        struct stat st;
+        if (fstat (fd, &st) != 0) {
+            slog_log_error ("Failed to stat %s: %s", stream->path, strerror (errno));
+            return 1;
+        }
+        m->pos = m->end = st.st_size;
+        m->active = 1;
+    }
+    if (m->base) {
+        munmap (m->base, m->size);
+        m->base = NULL;
+    }
+
+    off_t start = m->pos & ~((off_t)sysconf (_SC_PAGESIZE) - 1);
+    size_t size = SLOG_MAP_CHUNK;
+    while ((off_t)(start + size) < m->pos + (off_t)len)
+        size += SLOG_MAP_CHUNK;
+
+    if (start + (off_t)size > m->end) {
+        /* reserve the blocks, so that a full disk fails here and not
+         * with SIGBUS on the memcpy (). Only a file system, which cannot
+         * reserve them, is grown sparse with ftruncate () */
+        int err = posix_fallocate (fd, m->end, start + size - m->end);
+        if (err == EOPNOTSUPP || err == EINVAL)
+            err = ftruncate (fd, start + size) != 0 ? errno : 0;
+        if (err != 0) {
+            slog_log_error ("Failed to grow %s: %s", stream->path, strerror (err));
+            /* for the caller, posix_fallocate () does not set it */
+            errno = err;
+            return 1;
+        }
+        m->end = start + size;
+    }
+
+    void *p = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, start);
+    if (p == MAP_FAILED) {
+        slog_log_error ("Failed to map %s: %s", stream->path, strerror (errno));
+        return 1;
+    }
+    m->base  = p;
+    m->start = start;
+    m->size  = size;
+    return 0;
+}
+
+char slog_map_write (slog_stream *stream, const char *entry, size_t len) {
+    slog_map *m = &stream->map;
+
+    if (!m->base || m->pos + (off_t)len > m->start + (off_t)m->size)
+        if (_map_window (stream, len) != 0)
+            return 1;
+
+    memcpy (m->base + (m->pos - m->start), entry, len);
+    m->pos += len;
+    return 0;
+}
+
+void slog_map_close (slog_stream *stream) {
+    slog_map *m = &stream->map;
+    if (!m->active)
+        return;
+
+    if (m->base)
+        munmap (m->base, m->size);
+    /* drop the allocated tail */
+    if (ftruncate (fileno (stream->file), m->pos) != 0)
+        slog_log_error ("Failed to truncate %s: %s", stream->path, strerror (errno));
+    m->base   = NULL;
+    m->active = 0;
+}
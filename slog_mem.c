@@ -9,16 +9,70 @@
 #include "slog_log.h"
 #include <assert.h>
 
-void *slog_xalloc (size_t nr) {
+static void *_mem_malloc (void *ctx, size_t nr) {
+    (void)ctx;
+    return malloc (nr);
+}
+static void *_mem_realloc (void *ctx, void *blk, size_t nr) {
+    (void)ctx;
+    return realloc (blk, nr);
+}
+static void _mem_free (void *ctx, void *blk) {
+    (void)ctx;
+    free (blk);
+}
+
+static slog_allocator slog_allocator_ = { _mem_malloc, _mem_realloc, _mem_free, NULL };
+
+void slog_set_allocator (const slog_allocator *alloc) {
+    if (!alloc) {
+        slog_allocator def = { _mem_malloc, _mem_realloc, _mem_free, NULL };
+        slog_allocator_ = def;
+        return;
+    }
+    assert (alloc->alloc && alloc->realloc && alloc->free);
+    slog_allocator_ = *alloc;
+}
+
+const slog_allocator *slog_mem_global (void) {
+    return &slog_allocator_;
+}
+
+void *slog_mem_alloc (const slog_allocator *alloc, size_t nr) {
     assert (nr > 0);
 
-    void *blk = malloc (nr);
+    if (!alloc)
+        alloc = &slog_allocator_;
+    void *blk = alloc->alloc (alloc->ctx, nr);
     if (!blk) {
         slog_log_error ("Could not allocate memory");
         return NULL;
     }
     return blk;
 }
+void *slog_mem_realloc (const slog_allocator *alloc, void *blk, size_t nr) {
+    assert (blk != NULL);
+
+    if (!alloc)
+        alloc = &slog_allocator_;
+    void *p = alloc->realloc (alloc->ctx, blk, nr);
+    if (!p) {
+        slog_log_error ("Could not reallocate memory");
+        return NULL;
+    }
+    return p;
+}
+void slog_mem_free (const slog_allocator *alloc, void *blk) {
+    assert (blk != NULL);
+
+    if (!alloc)
+        alloc = &slog_allocator_;
+    alloc->free (alloc->ctx, blk);
+}
+
+void *slog_xalloc (size_t nr) {
+    return slog_mem_alloc (NULL, nr);
+}
 void *slog_xalloc_die (size_t nr) {
     void *blk = slog_xalloc (nr);
     if (!blk) {
@@ -28,15 +82,8 @@ void *slog_xalloc_die (size_t nr) {
     return blk;
 }
 void *slog_realloc (void *blk, size_t nr) {
-    assert (blk != NULL);
-    void *p = realloc (blk, nr);
-    if (!p) {
-        slog_log_error ("Could not reallocate memory");
-        return NULL;
-    }
-    return p;
+    return slog_mem_realloc (NULL, blk, nr);
 }
 void slog_free (void *blk) {
-    assert (blk != NULL);
-    free (blk);
+    slog_mem_free (NULL, blk);
 }
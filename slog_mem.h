@@ -8,6 +8,7 @@
 #define __SLOC_MEM_H__
 
 #include "slog_export.h"
+#include "slog_alloc.h"
 #include <stddef.h>
 
 /* just inform the user if allocation was failed */
@@ -17,4 +18,12 @@ SLOG_API void *slog_xalloc_die (size_t nr);
 SLOG_API void *slog_realloc (void *, size_t);
 SLOG_API void  slog_free (void *);
 
+/* slog_mem_alloc, slog_mem_realloc, slog_mem_free - the same with an
+ * allocator, NULL stands for the global one (see: slog_set_allocator ()) */
+SLOG_API void *slog_mem_alloc (const slog_allocator *alloc, size_t nr);
+SLOG_API void *slog_mem_realloc (const slog_allocator *alloc, void *blk, size_t nr);
+SLOG_API void  slog_mem_free (const slog_allocator *alloc, void *blk);
+/* slog_mem_global - get the global allocator */
+SLOG_API const slog_allocator *slog_mem_global (void);
+
 #endif
@@ -0,0 +1,447 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+/* The printf-compatible formatter of the messages. The output goes
+ * straight into the buffer in a single pass over the format: literal runs
+ * are copied, integers, strings and characters are converted here. The
+ * conversions, which are rarely seen in log messages (floating point, %p,
+ * wide characters), are handed to snprintf () one at a time, a format with
+ * positional arguments ("%1$s") or a conversion unknown here to
+ * vsnprintf () as a whole. */
+
+#include "slog_buf.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <wchar.h>
+
+/* the conversion flags */
+#define SLOG_PF_LEFT  (1u << 0)
+#define SLOG_PF_PLUS  (1u << 1)
+#define SLOG_PF_SPACE (1u << 2)
+#define SLOG_PF_ALT   (1u << 3)
+#define SLOG_PF_ZERO  (1u << 4)
+
+/* the length modifiers */
+typedef enum slog_pf_len {
+    slog_pf_none,
+    slog_pf_hh,
+    slog_pf_h,
+    slog_pf_l,
+    slog_pf_ll,
+    slog_pf_j,
+    slog_pf_z,
+    slog_pf_t,
+    slog_pf_L
+} slog_pf_len;
+
+/* a parsed conversion specification */
+typedef struct slog_pf_spec {
+    unsigned int flags;
+    int width;
+    /* -1 if not given */
+    int prec;
+    slog_pf_len len;
+    char conv;
+} slog_pf_spec;
+
+const char slog_digits2[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/* append `n` copies of `c` */
+static void _pf_pad (slog_buf *buf, char c, size_t n) {
+    if (!n)
+        return;
+    size_t room = slog_buf_reserve (buf, n);
+    if (room)
+        memset (buf->data + buf->len, c, room);
+    buf->len += n;
+}
+
+/* write the digits of `v` so that they end at `end`
+ * @return
+ *   pointer to the first digit */
+static char *_pf_utoa (char *end, unsigned long long v, unsigned int base, int upper) {
+    char *p = end;
+    if (base == 10) {
+        /* two digits at a time */
+        while (v >= 100) {
+            unsigned int r = (unsigned int)(v % 100) * 2;
+            v /= 100;
+            *--p = slog_digits2[r + 1];
+            *--p = slog_digits2[r];
+        }
+        if (v >= 10) {
+            *--p = slog_digits2[v * 2 + 1];
+            *--p = slog_digits2[v * 2];
+        } else {
+            *--p = '0' + (char)v;
+        }
+        return p;
+    }
+
+    const char *xdigits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    unsigned int shift = base == 16 ? 4 : 3;
+    do {
+        *--p = xdigits[v & (base - 1)];
+        v >>= shift;
+    } while (v);
+    return p;
+}
+
+/* append the padded and prefixed `digits` of an integer conversion */
+static void _pf_number (slog_buf *buf, const slog_pf_spec *spec, const char *prefix,
+        size_t plen, const char *digits, size_t dlen) {
+    /* the precision is the minimal number of digits */
+    size_t zeros = spec->prec >= 0 && (size_t)spec->prec > dlen ? spec->prec - dlen : 0;
+    size_t total = plen + zeros + dlen;
+    size_t pad   = spec->width > 0 && (size_t)spec->width > total ? spec->width - total : 0;
+
+    if (!(spec->flags & SLOG_PF_LEFT)) {
+        if ((spec->flags & SLOG_PF_ZERO) && spec->prec < 0)
+            zeros += pad;
+        else
+            _pf_pad (buf, ' ', pad);
+    }
+    slog_buf_append (buf, prefix, plen);
+    _pf_pad (buf, '0', zeros);
+    slog_buf_append (buf, digits, dlen);
+    if (spec->flags & SLOG_PF_LEFT)
+        _pf_pad (buf, ' ', pad);
+}
+
+static void _pf_integer (slog_buf *buf, const slog_pf_spec *spec, va_list *list) {
+    unsigned long long v;
+    int neg = 0;
+
+    if (spec->conv == 'd' || spec->conv == 'i') {
+        long long s;
+        switch (spec->len) {
+            case slog_pf_hh: s = (signed char)va_arg (*list, int); break;
+            case slog_pf_h:  s = (short)va_arg (*list, int); break;
+            case slog_pf_l:  s = va_arg (*list, long); break;
+            case slog_pf_ll: s = va_arg (*list, long long); break;
+            case slog_pf_j:  s = va_arg (*list, intmax_t); break;
+            case slog_pf_z:  s = va_arg (*list, ssize_t); break;
+            case slog_pf_t:  s = va_arg (*list, ptrdiff_t); break;
+            default:         s = va_arg (*list, int); break;
+        }
+        neg = s < 0;
+        v = neg ? 0ull - (unsigned long long)s : (unsigned long long)s;
+    } else {
+        switch (spec->len) {
+            case slog_pf_hh: v = (unsigned char)va_arg (*list, unsigned int); break;
+            case slog_pf_h:  v = (unsigned short)va_arg (*list, unsigned int); break;
+            case slog_pf_l:  v = va_arg (*list, unsigned long); break;
+            case slog_pf_ll: v = va_arg (*list, unsigned long long); break;
+            case slog_pf_j:  v = va_arg (*list, uintmax_t); break;
+            case slog_pf_z:  v = va_arg (*list, size_t); break;
+            case slog_pf_t:  v = (unsigned long long)va_arg (*list, ptrdiff_t); break;
+            default:         v = va_arg (*list, unsigned int); break;
+        }
+    }
+
+    char digits[24], *end = digits + sizeof (digits), *p = end;
+    unsigned int base = spec->conv == 'o' ? 8 : spec->conv == 'x' || spec->conv == 'X' ? 16 : 10;
+    /* zero with zero precision has no digits */
+    if (v || spec->prec != 0)
+        p = _pf_utoa (end, v, base, spec->conv == 'X');
+
+    char prefix[2];
+    size_t plen = 0;
+    if (base == 10) {
+        if (neg)
+            prefix[plen++] = '-';
+        else if (spec->conv != 'u' && (spec->flags & SLOG_PF_PLUS))
+            prefix[plen++] = '+';
+        else if (spec->conv != 'u' && (spec->flags & SLOG_PF_SPACE))
+            prefix[plen++] = ' ';
+    } else if (spec->flags & SLOG_PF_ALT) {
+        if (base == 16 && v) {
+            prefix[plen++] = '0';
+            prefix[plen++] = spec->conv;
+        } else if (base == 8 && (p == end || *p != '0')
+                && (spec->prec < 0 || (size_t)spec->prec <= (size_t)(end - p))) {
+            /* the alternative form of octal starts with a zero */
+            *--p = '0';
+        }
+    }
+    _pf_number (buf, spec, prefix, plen, p, end - p);
+}
+
+static void _pf_string (slog_buf *buf, const slog_pf_spec *spec, const char *s, size_t n) {
+    size_t pad = spec->width > 0 && (size_t)spec->width > n ? spec->width - n : 0;
+    if (!(spec->flags & SLOG_PF_LEFT))
+        _pf_pad (buf, ' ', pad);
+    slog_buf_append (buf, s, n);
+    if (spec->flags & SLOG_PF_LEFT)
+        _pf_pad (buf, ' ', pad);
+}
+
+/* snprintf () the conversion of `value` into the buffer, the value must
+ * not have side effects as it is evaluated again if the buffer is grown */
+#define _pf_snprintf(buf, str, value) do {\
+        size_t room_ = (buf)->len < (buf)->size ? (buf)->size - (buf)->len : 0;\
+        int n_ = snprintf (room_ ? (buf)->data + (buf)->len : NULL, room_, str, value);\
+        if (n_ < 0)\
+            break;\
+        if ((size_t)n_ >= room_ && !(buf)->fixed) {\
+            if (slog_buf_reserve (buf, n_) < (size_t)n_)\
+                break;\
+            (void)snprintf ((buf)->data + (buf)->len, n_ + 1, str, value);\
+        }\
+        (buf)->len += n_;\
+    } while (0)
+
+/* a conversion, which is not handled here, is rebuilt with the widths
+ * taken from the arguments and given to snprintf () */
+static void _pf_libc (slog_buf *buf, const slog_pf_spec *spec, va_list *list) {
+    char str[48], *p = str;
+    *p++ = '%';
+    if (spec->flags & SLOG_PF_LEFT)  *p++ = '-';
+    if (spec->flags & SLOG_PF_PLUS)  *p++ = '+';
+    if (spec->flags & SLOG_PF_SPACE) *p++ = ' ';
+    if (spec->flags & SLOG_PF_ALT)   *p++ = '#';
+    if (spec->flags & SLOG_PF_ZERO)  *p++ = '0';
+    if (spec->width > 0)
+        p += sprintf (p, "%d", spec->width);
+    if (spec->prec >= 0)
+        p += sprintf (p, ".%d", spec->prec);
+    if (spec->len == slog_pf_l)
+        *p++ = 'l';
+    else if (spec->len == slog_pf_L)
+        *p++ = 'L';
+    *p++ = spec->conv;
+    *p   = 0x0;
+
+    switch (spec->conv) {
+        case 'p': {
+            void *v = va_arg (*list, void *);
+            _pf_snprintf (buf, str, v);
+            break;
+        }
+        case 'c': {
+            wint_t v = va_arg (*list, wint_t);
+            _pf_snprintf (buf, str, v);
+            break;
+        }
+        case 's': {
+            const wchar_t *v = va_arg (*list, const wchar_t *);
+            _pf_snprintf (buf, str, v);
+            break;
+        }
+        default:
+            if (spec->len == slog_pf_L) {
+                long double v = va_arg (*list, long double);
+                _pf_snprintf (buf, str, v);
+            } else {
+                double v = va_arg (*list, double);
+                _pf_snprintf (buf, str, v);
+            }
+            break;
+    }
+}
+
+/* store the number of characters written so far */
+static void _pf_count (const slog_pf_spec *spec, va_list *list, size_t n) {
+    switch (spec->len) {
+        case slog_pf_hh: *va_arg (*list, signed char *) = (signed char)n; break;
+        case slog_pf_h:  *va_arg (*list, short *) = (short)n; break;
+        case slog_pf_l:  *va_arg (*list, long *) = (long)n; break;
+        case slog_pf_ll: *va_arg (*list, long long *) = (long long)n; break;
+        case slog_pf_j:  *va_arg (*list, intmax_t *) = (intmax_t)n; break;
+        case slog_pf_z:  *va_arg (*list, ssize_t *) = (ssize_t)n; break;
+        case slog_pf_t:  *va_arg (*list, ptrdiff_t *) = (ptrdiff_t)n; break;
+        default:         *va_arg (*list, int *) = (int)n; break;
+    }
+}
+
+/* parse a conversion specification after the '%', the widths given by
+ * '*' are taken from the arguments
+ * @return
+ *   pointer past the specification */
+static const char *_pf_parse (const char *p, slog_pf_spec *spec, va_list *list) {
+    spec->flags = 0;
+    spec->width = 0;
+    spec->prec  = -1;
+    spec->len   = slog_pf_none;
+
+    for (;; ++p) {
+        switch (*p) {
+            case '-': spec->flags |= SLOG_PF_LEFT;  continue;
+            case '+': spec->flags |= SLOG_PF_PLUS;  continue;
+            case ' ': spec->flags |= SLOG_PF_SPACE; continue;
+            case '#': spec->flags |= SLOG_PF_ALT;   continue;
+            case '0': spec->flags |= SLOG_PF_ZERO;  continue;
+        }
+        break;
+    }
+
+    if (*p == '*') {
+        spec->width = va_arg (*list, int);
+        if (spec->width < 0) {
+            spec->flags |= SLOG_PF_LEFT;
+            spec->width  = -spec->width;
+        }
+        ++p;
+    } else {
+        while (*p >= '0' && *p <= '9')
+            spec->width = spec->width * 10 + (*p++ - '0');
+    }
+
+    if (*p == '.') {
+        ++p;
+        if (*p == '*') {
+            spec->prec = va_arg (*list, int);
+            if (spec->prec < 0)
+                spec->prec = -1;
+            ++p;
+        } else {
+            spec->prec = 0;
+            while (*p >= '0' && *p <= '9')
+                spec->prec = spec->prec * 10 + (*p++ - '0');
+        }
+    }
+
+    switch (*p) {
+        case 'h':
+            spec->len = p[1] == 'h' ? slog_pf_hh : slog_pf_h;
+            p += p[1] == 'h' ? 2 : 1;
+            break;
+        case 'l':
+            spec->len = p[1] == 'l' ? slog_pf_ll : slog_pf_l;
+            p += p[1] == 'l' ? 2 : 1;
+            break;
+        case 'q': spec->len = slog_pf_ll; ++p; break;
+        case 'j': spec->len = slog_pf_j;  ++p; break;
+        case 'z': spec->len = slog_pf_z;  ++p; break;
+        case 't': spec->len = slog_pf_t;  ++p; break;
+        case 'L': spec->len = slog_pf_L;  ++p; break;
+    }
+    spec->conv = *p;
+    return *p ? p + 1 : p;
+}
+
+/* the whole format through vsnprintf (), for positional arguments */
+static void _pf_vsnprintf (slog_buf *buf, const char *fmt, va_list *list) {
+    size_t room = buf->len < buf->size ? buf->size - buf->len : 0;
+
+    va_list vac;
+    va_copy (vac, *list);
+    int n = vsnprintf (room ? buf->data + buf->len : NULL, room, fmt, vac);
+    va_end (vac);
+    if (n < 0)
+        return;
+
+    if ((size_t)n >= room && !buf->fixed) {
+        room = slog_buf_reserve (buf, n);
+        if (room < (size_t)n)
+            return;
+        va_copy (vac, *list);
+        (void)vsnprintf (buf->data + buf->len, n + 1, fmt, vac);
+        va_end (vac);
+    }
+    buf->len += n;
+}
+
+void slog_buf_vprintf (slog_buf *buf, const char *fmt, va_list *list) {
+    /* for %m, before growing the buffer may change it */
+    int err = errno;
+    if (strchr (fmt, '$')) {
+        _pf_vsnprintf (buf, fmt, list);
+        return;
+    }
+
+    /* the caller's list is left as it is */
+    va_list vac;
+    va_copy (vac, *list);
+    size_t start = buf->len;
+    const char *p = fmt;
+    while (*p) {
+        const char *pct = strchr (p, '%');
+        if (!pct) {
+            slog_buf_append (buf, p, strlen (p));
+            break;
+        }
+        if (pct != p)
+            slog_buf_append (buf, p, pct - p);
+
+        slog_pf_spec spec;
+        const char *spec_start = pct + 1;
+        p = _pf_parse (spec_start, &spec, &vac);
+        switch (spec.conv) {
+            case 'd': case 'i': case 'u':
+            case 'o': case 'x': case 'X':
+                _pf_integer (buf, &spec, &vac);
+                break;
+            case 's':
+                if (spec.len == slog_pf_l) {
+                    _pf_libc (buf, &spec, &vac);
+                } else {
+                    const char *s = va_arg (vac, const char *);
+                    if (!s)
+                        /* as glibc does */
+                        s = spec.prec < 0 || spec.prec >= 6 ? "(null)" : "";
+                    _pf_string (buf, &spec, s, spec.prec >= 0 ? strnlen (s, spec.prec) : strlen (s));
+                }
+                break;
+            case 'c':
+                if (spec.len == slog_pf_l) {
+                    _pf_libc (buf, &spec, &vac);
+                } else {
+                    char c = (char)va_arg (vac, int);
+                    _pf_string (buf, &spec, &c, 1);
+                }
+                break;
+            case '%':
+                slog_buf_append (buf, "%", 1);
+                break;
+            case 'n':
+                _pf_count (&spec, &vac, buf->len - start);
+                break;
+            case 0x0:
+                /* a lone '%' at the end is dropped */
+                break;
+            case 'f': case 'F': case 'e': case 'E':
+            case 'g': case 'G': case 'a': case 'A':
+            case 'p':
+                _pf_libc (buf, &spec, &vac);
+                break;
+            case 'C': case 'S':
+                /* the same as %lc and %ls */
+                spec.len  = slog_pf_l;
+                spec.conv = spec.conv == 'C' ? 'c' : 's';
+                _pf_libc (buf, &spec, &vac);
+                break;
+            case 'm': {
+                const char *s = strerror (err);
+                _pf_string (buf, &spec, s, spec.prec >= 0 ? strnlen (s, spec.prec) : strlen (s));
+                break;
+            }
+            default:
+                /* unknown to us, the arguments cannot be followed any
+                 * further, so the C library formats the whole message */
+                va_end (vac);
+                buf->len = start;
+                _pf_vsnprintf (buf, fmt, list);
+                return;
+        }
+    }
+    va_end (vac);
+}
@@ -0,0 +1,229 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+/* The flight recorder keeps the last entries of a stream, suppressed levels
+ * included, in a ring of bytes. A writer reserves the room for its entry
+ * with a single fetch-and-add and copies the entry in, there is no lock.
+ * The ring is dumped with plain write () calls, so that it can be done from
+ * a signal handler. An entry, which is still being copied or was partly
+ * overwritten, may come out garbled in such a dump. */
+
+#include "slog_stream.h"
+#include "slog_log.h"
+#include "slog_mem.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/* maximal number of streams dumped by the signal handler */
+#define SLOG_RECORDERS_MAX 16
+/* the smallest ring */
+#define SLOG_RECORDER_MIN 4096
+
+#define SLOG_RECORDER_BEGIN "--- flight recorder ---\n"
+#define SLOG_RECORDER_END   "--- end of flight recorder ---\n"
+
+/* the streams with a flight recorder, for the signal handler */
+static _Atomic (slog_stream *) slog_recorders_[SLOG_RECORDERS_MAX];
+
+/* the recorded bytes as (at most) two pieces, the first entry is skipped
+ * if the ring has wrapped over its beginning */
+static int _recorder_pieces (slog_recorder *rec, struct iovec *iov) {
+    unsigned long long head = atomic_load_explicit (&rec->head, memory_order_acquire);
+    size_t n = head < rec->size ? (size_t)head : rec->size;
+    size_t off = (size_t)(head - n) & (rec->size - 1);
+
+    if (head > rec->size) {
+        while (n && rec->data[off] != '\n') {
+            off = (off + 1) & (rec->size - 1);
+            --n;
+        }
+        if (n) {
+            off = (off + 1) & (rec->size - 1);
+            --n;
+        }
+    }
+
+    size_t first = rec->size - off < n ? rec->size - off : n;
+    iov[0].iov_base = rec->data + off;
+    iov[0].iov_len  = first;
+    iov[1].iov_base = rec->data;
+    iov[1].iov_len  = n - first;
+    return n - first ? 2 : 1;
+}
+
+/* write the dump with write (), which is safe in a signal handler */
+static void _recorder_write (slog_recorder *rec, int fd) {
+    struct iovec iov[4];
+    iov[0].iov_base = (char *)SLOG_RECORDER_BEGIN;
+    iov[0].iov_len  = sizeof (SLOG_RECORDER_BEGIN) - 1;
+    int n = 1 + _recorder_pieces (rec, iov + 1);
+    iov[n].iov_base = (char *)SLOG_RECORDER_END;
+    iov[n].iov_len  = sizeof (SLOG_RECORDER_END) - 1;
+
+    int i;
+    for (i = 0; i <= n; ++i) {
+        const char *p = iov[i].iov_base;
+        size_t len = iov[i].iov_len;
+        while (len) {
+            ssize_t w = write (fd, p, len);
+            if (w < 0) {
+                if (errno == EINTR)
+                    continue;
+                return;
+            }
+            p   += w;
+            len -= w;
+        }
+    }
+}
+
+/* where a dump from the signal handler goes, a mapped file is only
+ * written through its mapping */
+static int _recorder_fd (slog_stream *stream) {
+    if (stream->map.enabled)
+        return STDERR_FILENO;
+    return stream->has_file ? fileno (stream->file) : STDOUT_FILENO;
+}
+
+static void _recorder_handler (int sig) {
+    int saved = errno;
+    unsigned int i;
+    for (i = 0; i < SLOG_RECORDERS_MAX; ++i) {
+        slog_stream *stream = atomic_load_explicit (&slog_recorders_[i], memory_order_acquire);
+        if (!stream)
+            continue;
+        slog_recorder *rec = atomic_load_explicit (&stream->recorder, memory_order_acquire);
+        if (rec)
+            _recorder_write (rec, _recorder_fd (stream));
+    }
+    errno = saved;
+    /* the handler was reset, the default action follows */
+    raise (sig);
+}
+
+char slog_recorder_start (slog_stream *stream, size_t size, unsigned int suppress) {
+    assert (stream != NULL);
+
+    if (stream->bin) {
+        slog_log_error ("Binary streams cannot have a flight recorder");
+        return 1;
+    }
+    if (atomic_load_explicit (&stream->recorder, memory_order_acquire))
+        return 0;
+
+    size_t n = SLOG_RECORDER_MIN;
+    while (n < size)
+        n <<= 1;
+    slog_recorder *rec = slog_mem_alloc (&stream->alloc, sizeof (slog_recorder));
+    if (!rec)
+        return 1;
+    rec->data = slog_mem_alloc (&stream->alloc, n);
+    if (!rec->data) {
+        slog_mem_free (&stream->alloc, rec);
+        return 1;
+    }
+    rec->size = n;
+    atomic_init (&rec->head, 0);
+    slog_levelset_mask (rec->skip, suppress, 1);
+
+    pthread_mutex_lock (&stream->lock);
+    slog_recorder *expected = NULL;
+    if (!atomic_compare_exchange_strong (&stream->recorder, &expected, rec)) {
+        pthread_mutex_unlock (&stream->lock);
+        slog_mem_free (&stream->alloc, rec->data);
+        slog_mem_free (&stream->alloc, rec);
+        return 0;
+    }
+    slog_stream_update_skip (stream);
+    pthread_mutex_unlock (&stream->lock);
+
+    unsigned int i;
+    for (i = 0; i < SLOG_RECORDERS_MAX; ++i) {
+        slog_stream *none = NULL;
+        if (atomic_compare_exchange_strong (&slog_recorders_[i], &none, stream))
+            return 0;
+    }
+    /* still dumped on slog_fatal () and slog_recorder_dump () */
+    slog_log_error ("Too many flight recorders for the signal handler");
+    return 0;
+}
+
+void slog_recorder_put (slog_recorder *rec, const char *entry, size_t len) {
+    if (len > rec->size)
+        return;
+
+    unsigned long long pos = atomic_fetch_add_explicit (&rec->head, len, memory_order_relaxed);
+    size_t off   = (size_t)pos & (rec->size - 1);
+    size_t first = rec->size - off;
+    if (first >= len) {
+        memcpy (rec->data + off, entry, len);
+    } else {
+        memcpy (rec->data + off, entry, first);
+        memcpy (rec->data, entry + first, len - first);
+    }
+}
+
+void slog_recorder_dump (slog_stream *stream) {
+    assert (stream != NULL);
+
+    slog_recorder *rec = atomic_load_explicit (&stream->recorder, memory_order_acquire);
+    if (!rec)
+        return;
+
+    /* the dump goes after everything written so far */
+    slog_drain (stream);
+    if (!stream->has_file) {
+        fflush (stdout);
+        _recorder_write (rec, STDOUT_FILENO);
+        return;
+    }
+
+    pthread_mutex_lock (&stream->lock);
+    if (stream->map.enabled) {
+        struct iovec iov[2];
+        int i, n = _recorder_pieces (rec, iov);
+        slog_map_write (stream, SLOG_RECORDER_BEGIN, sizeof (SLOG_RECORDER_BEGIN) - 1);
+        for (i = 0; i < n; ++i)
+            slog_map_write (stream, iov[i].iov_base, iov[i].iov_len);
+        slog_map_write (stream, SLOG_RECORDER_END, sizeof (SLOG_RECORDER_END) - 1);
+    } else {
+        if (stream->direct)
+            slog_direct_flush_file (stream);
+        else
+            fflush (stream->file);
+        _recorder_write (rec, fileno (stream->file));
+    }
+    pthread_mutex_unlock (&stream->lock);
+}
+
+char slog_recorder_on_signal (int sig) {
+    struct sigaction sa;
+    memset (&sa, 0, sizeof (sa));
+    sa.sa_handler = _recorder_handler;
+    sa.sa_flags   = SA_RESETHAND;
+    sigemptyset (&sa.sa_mask);
+    return sigaction (sig, &sa, NULL) != 0;
+}
+
+void slog_recorder_close (slog_stream *stream) {
+    slog_recorder *rec = atomic_load_explicit (&stream->recorder, memory_order_relaxed);
+    if (!rec)
+        return;
+
+    unsigned int i;
+    for (i = 0; i < SLOG_RECORDERS_MAX; ++i) {
+        slog_stream *self = stream;
+        atomic_compare_exchange_strong (&slog_recorders_[i], &self, NULL);
+    }
+    atomic_store_explicit (&stream->recorder, NULL, memory_order_relaxed);
+    slog_mem_free (&stream->alloc, rec->data);
+    slog_mem_free (&stream->alloc, rec);
+}
@@ -0,0 +1,300 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+/* Rotation renames "<path>" to "<path>.1" (shifting the older files up to
+ * "<path>.<max_files>") and moves the pre-opened "<path>.next" in its place,
+ * so the writers only wait for a few renames. The previous file is closed
+ * (and flushed to its new name) and the next successor is opened after
+ * the stream lock is released. */
+
+#include "slog_stream.h"
+#include "slog_log.h"
+#include "slog_mem.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/* bumped by the signal handler, every stream reopens its file once it
+ * notices the change */
+static atomic_int slog_reopen_gen_;
+
+static void _reopen_handler (int sig) {
+    (void)sig;
+    atomic_fetch_add_explicit (&slog_reopen_gen_, 1, memory_order_relaxed);
+}
+
+/* "<path><suffix>" in a new allocation */
+static char *_rotate_name (const char *path, const char *suffix) {
+    size_t len = strlen (path), slen = strlen (suffix);
+    char *name = slog_xalloc (len + slen + 1);
+    if (!name)
+        return NULL;
+    memcpy (name, path, len);
+    memcpy (name + len, suffix, slen + 1);
+    return name;
+}
+
+/* mappings require the file to be readable */
+#define _rotate_mode(stream, mode) ((stream)->map.enabled ? mode "+" : mode)
+
+static FILE *_rotate_open_next (slog_stream *stream) {
+    char *name = _rotate_name (stream->path, ".next");
+    if (!name)
+        return NULL;
+    FILE *f = fopen (name, _rotate_mode (stream, "w"));
+    if (!f)
+        slog_log_error ("Failed to open file %s for writing: %s", name, strerror (errno));
+    slog_free (name);
+    return f;
+}
+
+static void _rotate_reset (slog_stream *stream) {
+    struct stat st;
+    /* the size of a mapped file includes the allocated tail */
+    if (stream->map.active)
+        stream->rot.bytes = stream->map.pos;
+    else
+        stream->rot.bytes = fstat (fileno (stream->file), &st) == 0 ? st.st_size : 0;
+    stream->rot.opened = time (NULL);
+}
+
+/* a failed rotation keeps the current file and is retried only after
+ * another max_bytes or interval, rather than before every entry */
+static void _rotate_defer (slog_stream *stream) {
+    stream->rot.bytes  = 0;
+    stream->rot.opened = time (NULL);
+}
+
+/* shift the retained files, move the current file to "<path>.1" and the
+ * successor `next` in its place. Returns non-zero if the current file is
+ * still at "<path>", the entries then go on to it */
+static char _rotate_shift (slog_stream *stream, const char *next) {
+    unsigned int i = stream->rot.policy.max_files;
+    char *from = slog_xalloc (strlen (stream->path) + 16),
+         *to   = slog_xalloc (strlen (stream->path) + 16);
+    char failed = 1;
+
+    if (from && to) {
+        for (; i > 1; --i) {
+            sprintf (from, "%s.%u", stream->path, i - 1);
+            sprintf (to, "%s.%u", stream->path, i);
+            /* most of them do not exist yet, any other error would make
+             * the next rename overwrite a retained file */
+            if (rename (from, to) != 0 && errno != ENOENT) {
+                slog_log_error ("Failed to rename %s to %s: %s", from, to, strerror (errno));
+                goto done;
+            }
+        }
+        sprintf (to, "%s.1", stream->path);
+        if (rename (stream->path, to) != 0) {
+            slog_log_error ("Failed to rename %s to %s: %s", stream->path, to, strerror (errno));
+        } else if (rename (next, stream->path) != 0) {
+            slog_log_error ("Failed to rename %s to %s: %s", next, stream->path, strerror (errno));
+            (void)rename (to, stream->path);
+        } else {
+            failed = 0;
+        }
+    }
+done:
+    if (from)
+        slog_free (from);
+    if (to)
+        slog_free (to);
+    return failed;
+}
+
+/* switch to the pre-opened successor (or open one right away) */
+static FILE *_rotate (slog_stream *stream) {
+    FILE *next = stream->rot.next;
+    char *name = _rotate_name (stream->path, ".next");
+    if (!name) {
+        _rotate_defer (stream);
+        return NULL;
+    }
+
+    if (!next) {
+        next = fopen (name, _rotate_mode (stream, "w"));
+        if (!next) {
+            slog_log_error ("Failed to open file %s for writing: %s", name, strerror (errno));
+            slog_free (name);
+            _rotate_defer (stream);
+            return NULL;
+        }
+    }
+
+    char failed = _rotate_shift (stream, name);
+    slog_free (name);
+    if (failed) {
+        stream->rot.next = next;
+        _rotate_defer (stream);
+        return NULL;
+    }
+
+    /* the batch of a direct stream belongs to the old file */
+    slog_direct_flush_file (stream);
+    slog_map_close (stream);
+    slog_flush_retire (stream);
+    FILE *prev = stream->file;
+    stream->file     = next;
+    stream->rot.next = NULL;
+    _rotate_reset (stream);
+    return prev;
+}
+
+/* reopen the path, after the file was moved away by someone else */
+static FILE *_reopen (slog_stream *stream) {
+    FILE *f = fopen (stream->path, _rotate_mode (stream, "a"));
+    if (!f) {
+        slog_log_error ("Failed to reopen file %s: %s", stream->path, strerror (errno));
+        return NULL;
+    }
+    slog_direct_flush_file (stream);
+    slog_map_close (stream);
+    slog_flush_retire (stream);
+    FILE *prev = stream->file;
+    stream->file = f;
+    _rotate_reset (stream);
+    return prev;
+}
+
+void slog_rotate_init (slog_stream *stream) {
+    memset (&stream->rot, 0, sizeof (slog_rotator));
+    stream->rot.reopen_seen = atomic_load_explicit (&slog_reopen_gen_, memory_order_relaxed);
+}
+
+FILE *slog_rotate_check (slog_stream *stream, size_t len) {
+    slog_rotator *rot = &stream->rot;
+
+    int gen = atomic_load_explicit (&slog_reopen_gen_, memory_order_relaxed);
+    if (gen != rot->reopen_seen && stream->path && !stream->bin) {
+        rot->reopen_seen = gen;
+        return _reopen (stream);
+    }
+    if (!rot->enabled)
+        return NULL;
+
+    /* an empty file is not rotated by size, the entry would not fit into
+     * the next one either */
+    if ((rot->policy.max_bytes && rot->bytes && rot->bytes + len > rot->policy.max_bytes)
+            || (rot->policy.interval && time (NULL) - rot->opened >= (time_t)rot->policy.interval))
+        return _rotate (stream);
+    return NULL;
+}
+
+void slog_rotate_finish (slog_stream *stream, FILE *prev) {
+    if (prev)
+        fclose (prev);
+    if (!stream->rot.enabled)
+        return;
+
+    pthread_mutex_lock (&stream->lock);
+    int need = stream->rot.next == NULL;
+    pthread_mutex_unlock (&stream->lock);
+    if (!need)
+        return;
+
+    FILE *next = _rotate_open_next (stream);
+    if (!next)
+        return;
+
+    pthread_mutex_lock (&stream->lock);
+    if (!stream->rot.next) {
+        stream->rot.next = next;
+        next = NULL;
+    }
+    pthread_mutex_unlock (&stream->lock);
+    if (next)
+        fclose (next);
+}
+
+void slog_rotate_clear (slog_stream *stream) {
+    if (!stream->rot.next)
+        return;
+
+    fclose (stream->rot.next);
+    stream->rot.next = NULL;
+    char *name = _rotate_name (stream->path, ".next");
+    if (name) {
+        (void)remove (name);
+        slog_free (name);
+    }
+}
+
+char slog_set_rotation (slog_stream *stream, const slog_rotation *policy) {
+    assert (stream != NULL);
+
+    if (policy && (!stream->path || stream->bin)) {
+        slog_log_error ("Only text streams with a path can be rotated");
+        return 1;
+    }
+
+    pthread_mutex_lock (&stream->lock);
+    if (policy) {
+        stream->rot.policy = *policy;
+        if (!stream->rot.policy.max_files)
+            stream->rot.policy.max_files = 1;
+        stream->rot.enabled = 1;
+        _rotate_reset (stream);
+    } else {
+        stream->rot.enabled = 0;
+    }
+    pthread_mutex_unlock (&stream->lock);
+
+    if (policy)
+        slog_rotate_finish (stream, NULL);
+    else
+        slog_rotate_clear (stream);
+    return 0;
+}
+
+char slog_rotate (slog_stream *stream) {
+    assert (stream != NULL);
+
+    if (!stream->path || stream->bin) {
+        slog_log_error ("Only text streams with a path can be rotated");
+        return 1;
+    }
+
+    slog_drain (stream);
+    pthread_mutex_lock (&stream->lock);
+    FILE *prev = _rotate (stream);
+    pthread_mutex_unlock (&stream->lock);
+    if (!prev)
+        return 1;
+    slog_rotate_finish (stream, prev);
+    return 0;
+}
+
+char slog_reopen (slog_stream *stream) {
+    assert (stream != NULL);
+
+    if (!stream->path || stream->bin) {
+        slog_log_error ("Only text streams with a path can be reopened");
+        return 1;
+    }
+
+    slog_drain (stream);
+    pthread_mutex_lock (&stream->lock);
+    FILE *prev = _reopen (stream);
+    pthread_mutex_unlock (&stream->lock);
+    if (!prev)
+        return 1;
+    slog_rotate_finish (stream, prev);
+    return 0;
+}
+
+char slog_reopen_on_signal (int sig) {
+    struct sigaction sa;
+    memset (&sa, 0, sizeof (sa));
+    sa.sa_handler = _reopen_handler;
+    sa.sa_flags   = SA_RESTART;
+    sigemptyset (&sa.sa_mask);
+    return sigaction (sig, &sa, NULL) != 0;
+}
@@ -0,0 +1,158 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+/* Sinks are plain text destinations of a stream: a FILE, a suppression
+ * mask and optionally a format of their own. Rotation, mappings and
+ * colors only apply to the stream's own outputs. */
+
+#include "slog_stream.h"
+#include "slog_log.h"
+#include "slog_mem.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+static int _sink_add (slog_stream *stream, FILE *file, unsigned char owned,
+        const char *fmt, unsigned int suppress) {
+    if (stream->bin) {
+        slog_log_error ("Binary streams cannot have sinks");
+        return -1;
+    }
+
+    slog_sink *sink = slog_mem_alloc (&stream->alloc, sizeof (slog_sink));
+    if (!sink)
+        return -1;
+    sink->file  = file;
+    sink->owned = owned;
+    sink->fmt   = NULL;
+    sink->alloc = &stream->alloc;
+    slog_levelset_mask (sink->skip, suppress, 1);
+    if (fmt && !(sink->fmt = slog_fmt_create_with (fmt, &stream->alloc))) {
+        slog_mem_free (&stream->alloc, sink);
+        return -1;
+    }
+    pthread_mutex_init (&sink->lock, NULL);
+
+    pthread_mutex_lock (&stream->lock);
+    unsigned int n = atomic_load_explicit (&stream->nsinks, memory_order_relaxed);
+    if (n == SLOG_SINKS_MAX) {
+        pthread_mutex_unlock (&stream->lock);
+        slog_log_error ("Too many sinks");
+        sink->owned = 0;
+        slog_sink_close (sink);
+        return -1;
+    }
+    stream->sinks[n] = sink;
+    atomic_store_explicit (&stream->nsinks, n + 1, memory_order_release);
+    slog_stream_update_skip (stream);
+    pthread_mutex_unlock (&stream->lock);
+    return n;
+}
+
+int slog_sink_add (slog_stream *stream, const char *path, unsigned int flags,
+        const char *fmt, unsigned int suppress) {
+    assert (stream != NULL);
+    assert (path != NULL);
+
+    FILE *file = fopen (path, (flags & slog_flags_rewrite) ? "w" : "a");
+    if (!file) {
+        slog_log_error ("Failed to open file %s for writing", path);
+        return -1;
+    }
+    int i = _sink_add (stream, file, 1, fmt, suppress);
+    if (i < 0)
+        fclose (file);
+    return i;
+}
+
+int slog_sink_desc (slog_stream *stream, FILE *fd, const char *fmt, unsigned int suppress) {
+    assert (stream != NULL);
+    assert (fd != NULL);
+    return _sink_add (stream, fd, 0, fmt, suppress);
+}
+
+void slog_sink_suppress (slog_stream *stream, int sink, unsigned int mask) {
+    assert (stream != NULL);
+
+    pthread_mutex_lock (&stream->lock);
+    if (sink >= 0 && (unsigned int)sink < atomic_load_explicit (&stream->nsinks, memory_order_relaxed)) {
+        slog_levelset_mask (stream->sinks[sink]->skip, mask, 0);
+        slog_stream_update_skip (stream);
+    }
+    pthread_mutex_unlock (&stream->lock);
+}
+
+void slog_sink_suppress_level (slog_stream *stream, int sink, const slog_loglevel *level,
+        unsigned char state) {
+    assert (stream != NULL);
+    assert (level != NULL);
+
+    pthread_mutex_lock (&stream->lock);
+    if (sink >= 0 && (unsigned int)sink < atomic_load_explicit (&stream->nsinks, memory_order_relaxed)) {
+        slog_levelset_set (stream->sinks[sink]->skip, level, state);
+        slog_stream_update_skip (stream);
+    }
+    pthread_mutex_unlock (&stream->lock);
+}
+
+void slog_levelset_mask (atomic_uint *set, unsigned int mask, char all) {
+    unsigned int i;
+    /* bit 0 stands for the unregistered levels, which are always written */
+    atomic_store_explicit (&set[0], mask & ~1u, memory_order_relaxed);
+    if (all)
+        for (i = 1; i < SLOG_LEVEL_WORDS; ++i)
+            atomic_store_explicit (&set[i], 0, memory_order_relaxed);
+}
+
+void slog_levelset_set (atomic_uint *set, const slog_loglevel *level, unsigned char state) {
+    if (!level->index)
+        return;
+    if (state)
+        atomic_fetch_or_explicit (&set[slog_level_word (level)], slog_level_bit (level), memory_order_relaxed);
+    else
+        atomic_fetch_and_explicit (&set[slog_level_word (level)], ~slog_level_bit (level), memory_order_relaxed);
+}
+
+void slog_stream_update_skip (slog_stream *stream) {
+    unsigned int n = atomic_load_explicit (&stream->nsinks, memory_order_relaxed), i, w;
+    slog_recorder *rec = atomic_load_explicit (&stream->recorder, memory_order_relaxed);
+
+    for (w = 0; w < SLOG_LEVEL_WORDS; ++w) {
+        unsigned int skip = atomic_load_explicit (&stream->suppress[w], memory_order_relaxed);
+        for (i = 0; i < n; ++i)
+            skip &= atomic_load_explicit (&stream->sinks[i]->skip[w], memory_order_relaxed);
+        if (rec)
+            skip &= atomic_load_explicit (&rec->skip[w], memory_order_relaxed);
+        __atomic_store_n (&stream->head.skip[w], skip, __ATOMIC_RELAXED);
+    }
+}
+
+char slog_sink_write (slog_sink *sink, const char *entry, size_t len) {
+    pthread_mutex_lock (&sink->lock);
+    char failed = fwrite (entry, 1, len, sink->file) < len;
+    if (failed)
+        slog_log_error ("Failed to write log entry to a sink: %s", strerror (errno));
+    pthread_mutex_unlock (&sink->lock);
+    return failed;
+}
+
+void slog_sink_flush (slog_sink *sink) {
+    pthread_mutex_lock (&sink->lock);
+    fflush (sink->file);
+    pthread_mutex_unlock (&sink->lock);
+}
+
+void slog_sink_close (slog_sink *sink) {
+    if (sink->owned)
+        fclose (sink->file);
+    else
+        fflush (sink->file);
+    if (sink->fmt)
+        slog_fmt_clear (sink->fmt);
+    pthread_mutex_destroy (&sink->lock);
+    slog_mem_free (sink->alloc, sink);
+}
@@ -0,0 +1,316 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+#ifndef __SLOG_STREAM_H__
+#define __SLOG_STREAM_H__
+
+#include "slog.h"
+#include "slog_async.h"
+#include "slog_bin.h"
+#include "slog_buf.h"
+#include "slog_fmt.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <time.h>
+
+/* size of the per-destination buffers of a direct asynchronous stream */
+#define SLOG_DIRECT_BUFSIZ (64 * 1024)
+
+/* memory-mapped files are grown and mapped by chunks of this size */
+#define SLOG_MAP_CHUNK (4 * 1024 * 1024)
+
+/* memory-mapped output of a stream, see slog_map.c */
+typedef struct slog_map {
+    /* the stream was created with slog_flags_mmap */
+    unsigned char enabled;
+    /* pos and end describe the current file */
+    unsigned char active;
+    /* the mapped window of the file and its offset */
+    char *base;
+    off_t start;
+    size_t size;
+    /* offset of the next entry */
+    off_t pos;
+    /* the file is allocated up to here */
+    off_t end;
+} slog_map;
+
+/* an additional destination of a stream, see slog_sink.c */
+typedef struct slog_sink {
+    FILE *file;
+    /* the file was opened by the sink and is closed with it */
+    unsigned char owned;
+    /* loglevels, which are not written to the sink (a bitset) */
+    atomic_uint skip[SLOG_LEVEL_WORDS];
+    /* format of the sink, NULL for the format of the stream */
+    slog_fmt *fmt;
+    /* the allocator of the stream */
+    const slog_allocator *alloc;
+    /* serializes the writes */
+    pthread_mutex_t lock;
+} slog_sink;
+
+/* the flight recorder of a stream, see slog_recorder.c */
+typedef struct slog_recorder {
+    char *data;
+    /* a power of 2 */
+    size_t size;
+    /* number of bytes recorded so far */
+    atomic_ullong head;
+    /* loglevels, which are not recorded (a bitset) */
+    atomic_uint skip[SLOG_LEVEL_WORDS];
+} slog_recorder;
+
+/* the counters of a stream, see slog_stats () */
+typedef struct slog_counters {
+    atomic_ullong emitted[SLOG_LEVELS_MAX];
+    atomic_ullong suppressed[SLOG_LEVELS_MAX];
+    atomic_ullong bytes_stdout;
+    atomic_ullong bytes_file;
+    atomic_ullong bytes_sinks[SLOG_SINKS_MAX];
+    atomic_ullong bytes_recorder;
+    atomic_ullong write_errors;
+    atomic_ullong flushes;
+    atomic_ullong syncs;
+    atomic_ullong buf_growths;
+    atomic_ullong format_ns;
+    atomic_ullong write_ns;
+} slog_counters;
+
+/* a format replaced by slog_format (), a writer might still be using it */
+typedef struct slog_fmt_retired {
+    slog_fmt *fmt;
+    struct slog_fmt_retired *next;
+} slog_fmt_retired;
+
+/* rotation state of a stream, see slog_rotate.c */
+typedef struct slog_rotator {
+    slog_rotation policy;
+    /* rotation by the policy is enabled */
+    unsigned char enabled;
+    /* size of the current file */
+    unsigned long long bytes;
+    /* when the current file was opened */
+    time_t opened;
+    /* pre-opened successor of the file ("<path>.next") */
+    FILE *next;
+    /* the last reopen request seen by the stream */
+    int reopen_seen;
+} slog_rotator;
+
+/* flush policy of a stream and its group commit, see slog_flush.c */
+typedef struct slog_flusher {
+    /* the policy (see: slog_set_flush ()), read by every entry */
+    atomic_uchar enabled;
+    atomic_uint entries;
+    atomic_uint interval_ms;
+    /* loglevels flushed right away (a bitset) */
+    atomic_uint levels[SLOG_LEVEL_WORDS];
+    /* the flushes of the policy are synced */
+    atomic_uchar sync;
+    /* entries checked so far */
+    atomic_uint count;
+    /* an entry of the current batch is due for a flush (only used by the
+     * writer thread of an asynchronous stream) */
+    unsigned char pending;
+    /* number of flushes of the file (locked by the stream) */
+    unsigned long long flushed;
+    /* the flushes up to `synced` are on disk, a thread is in fdatasync ()
+     * for the others while `syncing` (locked) */
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    unsigned long long synced;
+    unsigned char syncing;
+    /* the thread flushing by interval_ms, woken up by `tick` to stop or
+     * to take a new interval (locked) */
+    pthread_t timer;
+    pthread_cond_t tick;
+    unsigned char timing;
+    unsigned char stop;
+} slog_flusher;
+
+struct slog_stream {
+    /* must come first, see slog_enabled () */
+    slog_stream_head head;
+    /* the memory of the stream and its parts (see: slog_create_with ()) */
+    slog_allocator alloc;
+    /* path to the file */
+    const char *path;
+    /* file descriptor, replaced under the lock on rotation */
+    FILE *file;
+    /* the stream has a file (without taking the lock) */
+    unsigned char has_file;
+    /* slog_fmt is a stream of tokens containing 
+     * the info about the format, replaced by slog_format () while
+     * other threads may be reading it */
+    _Atomic (struct slog_fmt *) fmt_head;
+    /* threads formatting with fmt_head (see: slog_format ()) */
+    atomic_uint fmt_users;
+    /* formats replaced by slog_format (), freed once no thread is
+     * formatting (changed under the lock) */
+    slog_fmt_retired *retired;
+    /* redirect to the secondary output */
+    atomic_uchar to_stdout;
+    /* should the output to stdout be colorized */
+    atomic_uchar colorized;
+    /* which loglevels should be suppressed (a bitset) */
+    atomic_uint suppress[SLOG_LEVEL_WORDS];
+    /* queue of the writer thread, NULL unless the stream is asynchronous */
+    slog_ring *ring;
+    /* what to do while the queue is full (slog_backpressure) */
+    atomic_int backpressure;
+    /* loglevels dropped by slog_backpressure_drop_below (a bitset) */
+    atomic_uint droppable[SLOG_LEVEL_WORDS];
+    /* format dictionary, NULL unless the stream is binary */
+    slog_bin *bin;
+    /* serializes the writes to the file with its rotation */
+    pthread_mutex_t lock;
+    slog_rotator rot;
+    slog_flusher flush;
+    /* write to the descriptors with writev (), bypassing stdio */
+    unsigned char direct;
+    /* the current batch of the writer thread of a direct stream, for
+     * stdout (only used by the writer thread) and for the file (locked) */
+    slog_buf dout,
+             dfile;
+    /* the file is written through a mapping (locked) */
+    slog_map map;
+    /* additional destinations, sink i is destination bit i + 1, bit 0
+     * stands for the stream's own outputs. Added under the lock, published
+     * by nsinks */
+    slog_sink *sinks[SLOG_SINKS_MAX];
+    atomic_uint nsinks;
+    /* the last entries, NULL unless started, freed with the stream */
+    _Atomic (slog_recorder *) recorder;
+    /* measure the time spent on the entries (slog_flags_timing) */
+    unsigned char timing;
+    /* kept apart from the settings above, which are read by every entry */
+    slog_counters stats;
+};
+
+/* the stream's own outputs as a destination (see: slog_stream.sinks) */
+#define SLOG_DST_STREAM 1u
+#define SLOG_DST_SINK(i) (1u << ((i) + 1))
+#define SLOG_DST_RECORDER (1u << 31)
+
+/* should the entries be written to stdout */
+#define slog_stream_stdout(stream)\
+    (!(stream)->bin && (!(stream)->has_file\
+        || atomic_load_explicit (&(stream)->to_stdout, memory_order_relaxed)))
+/* should the output to stdout be colorized */
+#define slog_stream_colorized(stream)\
+    atomic_load_explicit (&(stream)->colorized, memory_order_relaxed)
+/* add to a counter of the stream (see: slog_counters) */
+#define slog_stream_count(stream, counter, n)\
+    atomic_fetch_add_explicit (&(stream)->stats.counter, (n), memory_order_relaxed)
+
+/* slog_rotate_init - initialize the rotation state of a new stream */
+SLOG_API void slog_rotate_init (slog_stream *stream);
+/* slog_rotate_check - called with the stream locked, before `len` bytes
+ * are written to the file. Switches to the next file, if the rotation
+ * policy or a reopen request says so
+ * @return
+ *   the previous file, which should be passed to slog_rotate_finish ()
+ *   once the lock is released, NULL if there was no switch */
+SLOG_API FILE *slog_rotate_check (slog_stream *stream, size_t len);
+/* slog_rotate_finish - close the previous file and pre-open the next one,
+ * called without the lock */
+SLOG_API void slog_rotate_finish (slog_stream *stream, FILE *prev);
+/* slog_rotate_clear - free the rotation state of a stream being closed */
+SLOG_API void slog_rotate_clear (slog_stream *stream);
+
+/* should an entry of a level be followed by a flush (see: slog_set_flush ()) */
+#define slog_flush_due(stream, level)\
+    (atomic_load_explicit (&(stream)->flush.enabled, memory_order_relaxed)\
+        && slog_flush_check (stream, level))
+/* does the caller wait for an entry of a level to be written out */
+#define slog_flush_urgent(stream, level)\
+    ((level) && atomic_load_explicit (&(stream)->flush.enabled, memory_order_relaxed)\
+        && slog_levelset_has ((stream)->flush.levels, level))
+/* are the flushes of the policy synced */
+#define slog_flush_syncs(stream)\
+    atomic_load_explicit (&(stream)->flush.sync, memory_order_relaxed)
+
+/* slog_flush_init - initialize the flush state of a new stream, no policy */
+SLOG_API void slog_flush_init (slog_stream *stream);
+/* slog_flush_stop - stop flushing the stream by its interval, the first
+ * thing done by slog_close () */
+SLOG_API void slog_flush_stop (slog_stream *stream);
+/* slog_flush_clear - free the flush state of a stream being closed */
+SLOG_API void slog_flush_clear (slog_stream *stream);
+/* slog_flush_check - apply the flush policy to an entry, see slog_flush_due () */
+SLOG_API int slog_flush_check (slog_stream *stream, const slog_loglevel *level);
+/* slog_flush_file - hand the buffered output of the file to the kernel,
+ * called with the stream locked
+ * @return
+ *   the number of the flush, to be passed to slog_flush_sync () */
+SLOG_API unsigned long long slog_flush_file (slog_stream *stream);
+/* slog_flush_sync - wait until the file is synced up to a flush, a single
+ * fdatasync () serves all of the concurrent callers. Called without the lock
+ * @return
+ *   0 on success, non-zero otherwise */
+SLOG_API char slog_flush_sync (slog_stream *stream, unsigned long long n);
+/* slog_flush_retire - sync the file before a rotation replaces it, if the
+ * policy syncs, called with the stream locked */
+SLOG_API void slog_flush_retire (slog_stream *stream);
+
+/* slog_direct_write - write an entry of a direct stream (see: slog_direct.c)
+ * @param batch
+ *   the entry may be kept in the buffers until slog_direct_flush () */
+SLOG_API void slog_direct_write (slog_stream *stream, const slog_loglevel *level,
+        const char *entry, size_t len, char batch);
+/* slog_direct_flush - write out the buffered entries of a direct stream */
+SLOG_API void slog_direct_flush (slog_stream *stream);
+/* slog_direct_flush_file - write out the buffered entries of the file,
+ * called with the stream locked before the file is switched */
+SLOG_API void slog_direct_flush_file (slog_stream *stream);
+/* slog_direct_clear - free the buffers of a stream being closed */
+SLOG_API void slog_direct_clear (slog_stream *stream);
+
+/* slog_map_write - copy an entry into the mapped file, called with
+ * the stream locked
+ * @return
+ *   0 on success, non-zero otherwise */
+SLOG_API char slog_map_write (slog_stream *stream, const char *entry, size_t len);
+/* slog_map_close - unmap the file and truncate it to the written length,
+ * called with the stream locked before the file is closed or switched */
+SLOG_API void slog_map_close (slog_stream *stream);
+
+/* slog_sink_write - write an entry to a sink
+ * @return
+ *   0 on success, non-zero otherwise */
+SLOG_API char slog_sink_write (slog_sink *sink, const char *entry, size_t len);
+/* slog_sink_flush - flush the buffered output of a sink */
+SLOG_API void slog_sink_flush (slog_sink *sink);
+/* slog_sink_close - close the file of a sink and free it */
+SLOG_API void slog_sink_close (slog_sink *sink);
+/* slog_recorder_put - copy an entry into the flight recorder */
+SLOG_API void slog_recorder_put (slog_recorder *rec, const char *entry, size_t len);
+/* slog_recorder_close - forget the flight recorder of a stream being
+ * closed and free it */
+SLOG_API void slog_recorder_close (slog_stream *stream);
+
+/* does a suppression bitset leave out a loglevel */
+#define slog_levelset_has(set, level)\
+    (atomic_load_explicit (&(set)[slog_level_word (level)], memory_order_relaxed)\
+        & slog_level_bit (level))
+
+/* slog_levelset_mask - set the loglevels of a suppression bitset, which
+ * have an id, from a mask (see: slog_suppress ())
+ * @param all
+ *   clear the other loglevels as well */
+SLOG_API void slog_levelset_mask (atomic_uint *set, unsigned int mask, char all);
+/* slog_levelset_set - add a loglevel to a suppression bitset or remove it */
+SLOG_API void slog_levelset_set (atomic_uint *set, const slog_loglevel *level, unsigned char state);
+
+/* slog_stream_update_skip - recompute the levels, which no output of the
+ * stream wants (slog_stream_head.skip), called with the stream locked */
+SLOG_API void slog_stream_update_skip (slog_stream *stream);
+
+#endif
@@ -0,0 +1,150 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+/* async.c - logging from several threads to an asynchronous stream */
+
+#include "../slog.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NTHREADS 4
+#define NMESSAGES 1000
+
+static void *worker (void *arg) {
+    slog_stream *stream = arg;
+    int i;
+    /* the calling thread only formats the entry and copies it into the queue */
+    for (i = 0; i < NMESSAGES; ++i)
+        slog_printf (stream, slog_loglevel_message, "entry %d", i);
+    return NULL;
+}
+
+/* read the pipe until its write end is closed */
+static void *reader (void *arg) {
+    int fd = *(int *)arg;
+    char buf[4096];
+    while (read (fd, buf, sizeof (buf)) > 0)
+        ;
+    return NULL;
+}
+
+/* stdout is a pipe nobody reads, the writer thread gets stuck on it. With
+ * slog_backpressure_drop_oldest the log calls must not wait for it */
+static int drop_oldest (void) {
+    int fds[2];
+    if (pipe (fds) != 0)
+        return 1;
+    fflush (stdout);
+    int saved = dup (STDOUT_FILENO);
+    dup2 (fds[1], STDOUT_FILENO);
+    close (fds[1]);
+    /* a hang fails the test */
+    alarm (30);
+
+    slog_stream *stream = slog_create (NULL, slog_flags_async);
+    if (!stream)
+        return 1;
+    slog_set_backpressure (stream, slog_backpressure_drop_oldest, 0);
+    /* larger than the buffer of stdout, the writer blocks in the middle
+     * of an entry */
+    static char payload[3 * BUFSIZ];
+    memset (payload, 'x', sizeof (payload) - 1);
+    int i;
+    for (i = 0; i < 20000; ++i)
+        slog_printf (stream, slog_loglevel_message, "stuck entry %d %s", i, payload);
+    unsigned long long dropped = slog_dropped (stream, NULL);
+
+    /* let the writer thread finish */
+    pthread_t thread;
+    pthread_create (&thread, NULL, reader, &fds[0]);
+    slog_close (stream);
+    fflush (stdout);
+    dup2 (saved, STDOUT_FILENO);
+    close (saved);
+    pthread_join (thread, NULL);
+    close (fds[0]);
+    alarm (0);
+
+    printf ("drop_oldest: %llu entries dropped\n", dropped);
+    return dropped == 0;
+}
+
+/* read the pipe slowly, the queue fills up but the writer goes on */
+static void *slow_reader (void *arg) {
+    int fd = *(int *)arg;
+    char buf[4096];
+    while (read (fd, buf, sizeof (buf)) > 0)
+        usleep (200);
+    return NULL;
+}
+
+/* the entries of an unsuppressible level are never evicted by
+ * slog_backpressure_drop_oldest, the others are */
+static int keep_unsuppressible (void) {
+    static slog_loglevel audit;
+    if (slog_newloglevel (&audit, "Audit", slog_color_yellow, 0) != 0)
+        return 1;
+
+    int fds[2];
+    if (pipe (fds) != 0)
+        return 1;
+    fflush (stdout);
+    int saved = dup (STDOUT_FILENO);
+    dup2 (fds[1], STDOUT_FILENO);
+    close (fds[1]);
+    alarm (30);
+    pthread_t thread;
+    pthread_create (&thread, NULL, slow_reader, &fds[0]);
+
+    slog_stream *stream = slog_create (NULL, slog_flags_none);
+    if (!stream || slog_async_start (stream, 16) != 0)
+        return 1;
+    slog_set_backpressure (stream, slog_backpressure_drop_oldest, 0);
+    static char payload[2048];
+    memset (payload, 'x', sizeof (payload) - 1);
+    int i;
+    for (i = 0; i < 4000; ++i) {
+        if (i % 100 == 0)
+            slog_printf (stream, &audit, "audit %d", i);
+        slog_printf (stream, slog_loglevel_message, "entry %d %s", i, payload);
+    }
+    unsigned long long dropped = slog_dropped (stream, NULL),
+                       kept = slog_dropped (stream, &audit);
+
+    slog_close (stream);
+    fflush (stdout);
+    dup2 (saved, STDOUT_FILENO);
+    close (saved);
+    pthread_join (thread, NULL);
+    close (fds[0]);
+    alarm (0);
+
+    printf ("keep_unsuppressible: %llu entries dropped, %llu of them audit\n", dropped, kept);
+    return kept != 0;
+}
+
+int main (void) {
+    /* the output is done by a writer thread */
+    slog_stream *stream = slog_create ("async.txt", slog_flags_async | slog_flags_nostdout | slog_flags_rewrite);
+    if (!stream)
+        return -1;
+
+    pthread_t threads[NTHREADS];
+    int i;
+    for (i = 0; i < NTHREADS; ++i)
+        pthread_create (&threads[i], NULL, worker, stream);
+    for (i = 0; i < NTHREADS; ++i)
+        pthread_join (threads[i], NULL);
+
+    /* wait until the queue is written out */
+    slog_drain (stream);
+    slog_message (stream, "done");
+    /* slog_close () writes out the rest of the queue */
+    slog_close (stream);
+    return drop_oldest () || keep_unsuppressible ();
+}
@@ -0,0 +1,28 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+/* binary.c - deferred logging, decode the output with:
+ *   slog-decode binary.bin */
+
+#include "../slog.h"
+
+int main (void) {
+    /* the messages are not formatted, only their arguments are recorded */
+    slog_stream *stream = slog_create ("binary.bin", slog_flags_binary | slog_flags_rewrite);
+    if (!stream)
+        return -1;
+    /* the layout is recorded as well, slog-decode renders the entries with it */
+    slog_format (stream, "[%l] %H:%m:%s: %L");
+
+    int i;
+    for (i = 0; i < 3; ++i)
+        slog_printf (stream, slog_loglevel_message, "request %d took %.3f ms (%s)", i, 0.25 * i, "ok");
+    slog_printf (stream, slog_loglevel_warning, "%-8s|%*d|%.*s|%p", "left", 5, 42, 3, "truncated", (void *)stream);
+    slog_puts (stream, slog_loglevel_error, "a plain message");
+
+    slog_close (stream);
+    return 0;
+}
@@ -0,0 +1,64 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+/* cxx.cpp - test of the C++ front end, the messages must be the same as
+ * those of slog_printf () */
+
+#include "../slog.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+static int failed = 0;
+
+/* compare the rendered message with snprintf () */
+#define CHECK(fmt, ...) do {\
+    char expected[256];\
+    std::snprintf (expected, sizeof (expected), fmt, __VA_ARGS__);\
+    char got[256];\
+    slog_buf out;\
+    slog_buf_init (&out, got, sizeof (got));\
+    slog::detail::write (out, SLOG_STR (fmt), __VA_ARGS__);\
+    slog_buf_terminate (&out);\
+    if (std::strcmp (got, expected) != 0) {\
+        std::printf ("mismatch: \"%s\" != \"%s\"\n", got, expected);\
+        failed = 1;\
+    }\
+} while (0)
+
+enum class color { red = 1, green = 2 };
+
+int main (void) {
+    CHECK ("%d|%5d|%-5d|%05d|%+d|% d|%.3d", 42, 42, 42, -42, 42, 42, 7);
+    CHECK ("%u %x %X %#x %#o %o %lld", 3000000000u, 255, 255, 255, 8, 0, -9223372036854775807ll);
+    CHECK ("[%c] [%3c] [%-3c]", 'a', 'b', 'c');
+    CHECK ("%s|%8s|%-8s|%.2s", "abc", "abc", "abc", "abc");
+    CHECK ("%f %.2f %10.3e %g %5.1f%%", 3.14159, 2.5, 12345.678, 0.0001, 99.94);
+    CHECK ("%.0d|%#.0o|%8.3d|%-8.3d|", 0, 0, 12, -12);
+    CHECK ("%p %p", (void *)&failed, (void *)nullptr);
+    CHECK ("%-70.2f|%70.3e|", 1.5, -2.25);
+
+    slog_stream *stream = slog_create (NULL, slog_flags_none);
+    if (!stream)
+        return -1;
+
+    slog::format (stream, SLOG_STR ("[%l] %F:%i %C: %L"));
+    std::string user = "alice";
+    SLOG_LOG (stream, slog_loglevel_message, "user %s has %d items (%.1f%%)", user, 3, 42.5);
+    SLOG_LOG (stream, slog_loglevel_message, "no arguments");
+    slog::warning (stream, SLOG_STR ("color %d, flag %s"), color::green, true);
+    slog::error (stream, SLOG_STR ("%s"), std::string_view ("a string view"));
+
+    /* these do not compile:
+     *   SLOG_LOG (stream, slog_loglevel_message, "%d", "text");
+     *   SLOG_LOG (stream, slog_loglevel_message, "%s %s", "one");
+     *   slog::format (stream, SLOG_STR ("%q")); */
+
+    slog_close (stream);
+
+    return failed;
+}
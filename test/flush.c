@@ -0,0 +1,46 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+/* flush.c - a flush policy with an interval writes out the last entries
+ * before an idle period */
+
+#include "../slog.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOGFILE "flush.txt"
+
+int main (void) {
+    slog_stream *stream = slog_create (LOGFILE, slog_flags_nostdout | slog_flags_rewrite);
+    if (!stream)
+        return -1;
+    slog_format (stream, "%L");
+    slog_flush_policy policy = { .interval_ms = 20 };
+    if (slog_set_flush (stream, &policy) != 0) {
+        slog_close (stream);
+        return -1;
+    }
+
+    slog_message (stream, "before the idle period");
+    /* no more entries come, the interval flushes the file anyway */
+    usleep (200 * 1000);
+
+    char got[64] = { 0 };
+    FILE *f = fopen (LOGFILE, "r");
+    if (f) {
+        if (!fgets (got, sizeof (got), f))
+            got[0] = 0x0;
+        fclose (f);
+    }
+    slog_close (stream);
+
+    if (strcmp (got, "before the idle period\n") != 0) {
+        printf ("not flushed: \"%s\"\n", got);
+        return 1;
+    }
+    return 0;
+}
@@ -14,6 +14,46 @@
 #include <stdio.h>
 /* malloc () */
 #include <stdlib.h>
+/* slog_desc () and slog_printf () */
+#include "../slog.h"
+#include <errno.h>
+#include <string.h>
+#include <wchar.h>
+
+/* the messages of slog_printf () must read as those of snprintf () */
+static int check_printf (void) {
+    FILE *f = tmpfile ();
+    slog_stream *stream = f ? slog_desc (f) : NULL;
+    if (!stream)
+        return -1;
+    slog_output_to_stdout (stream, 0);
+    slog_format (stream, "%L");
+
+    char expected[256], got[256];
+    errno = ENOENT;
+    snprintf (expected, sizeof (expected), "open failed: %m|%-12.6m|%lc|%ls|%C|%S|%d",
+            L'w', L"wide", L'W', L"WIDE", 42);
+    errno = ENOENT;
+    slog_printf (stream, slog_loglevel_message, "open failed: %m|%-12.6m|%lc|%ls|%C|%S|%d",
+            L'w', L"wide", L'W', L"WIDE", 42);
+    /* unknown to slog, left to the C library (not a literal, so that
+     * the compiler does not warn about it) */
+    const char *unknown = "%y|%d";
+    strcat (expected, "\n%y|7\n");
+    slog_printf (stream, slog_loglevel_message, unknown, 7);
+
+    fflush (f);
+    rewind (f);
+    size_t n = fread (got, 1, sizeof (got) - 1, f);
+    got[n] = 0x0;
+    slog_close (stream);
+
+    if (strcmp (got, expected) != 0) {
+        printf ("mismatch:\n%s\nexpected:\n%s\n", got, expected);
+        return -1;
+    }
+    return 0;
+}
 
 int main (void) {
     /* we need an slog_fmt struct to which the format will be written */
@@ -28,7 +68,13 @@ int main (void) {
     puts (mbuf);
     /* don't forget to free the string */
     free (mbuf);
+
+    /* slog_fmt_write() formats into a buffer of our own without allocating,
+     * returning the length of the entry, just like snprintf() does */
+    char sbuf[128];
+    if (slog_fmt_write (slog_loglevel_warning, fmt, sbuf, sizeof (sbuf), "Stack buffer") < sizeof (sbuf))
+        puts (sbuf);
     /* free up the fmt structure */
     slog_fmt_clear (fmt);
-    return 0;
+    return check_printf ();
 }
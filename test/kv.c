@@ -0,0 +1,69 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+/* kv.c - structured entries as JSON lines, logfmt and text */
+
+#include "../slog.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* logfmt keys, which a parser could not split, are written with '_' */
+static int check_keys (void) {
+    FILE *f = tmpfile ();
+    slog_stream *stream = f ? slog_desc (f) : NULL;
+    if (!stream)
+        return -1;
+    slog_output_to_stdout (stream, 0);
+    slog_format (stream, "%L");
+
+    const char *expected = "keys a_b=1 c_d=2 _e_=3 _=4 ok=\"x y\"\n";
+    char got[256];
+    slog_kv (stream, slog_loglevel_message, "keys",
+            SLOG_KV_INT ("a b", 1), SLOG_KV_INT ("c=d", 2), SLOG_KV_INT ("\"e\"", 3),
+            SLOG_KV_INT ("", 4), SLOG_KV_STR ("ok", "x y"), NULL);
+
+    fflush (f);
+    rewind (f);
+    size_t n = fread (got, 1, sizeof (got) - 1, f);
+    got[n] = 0x0;
+    slog_close (stream);
+
+    if (strcmp (got, expected) != 0) {
+        printf ("mismatch:\n%s\nexpected:\n%s\n", got, expected);
+        return -1;
+    }
+    return 0;
+}
+
+int main (void) {
+    slog_stream *stream = slog_create (NULL, slog_flags_none);
+    if (!stream)
+        return -1;
+
+    /* a JSON object per line */
+    slog_format (stream, "%J");
+    slog_kv (stream, slog_loglevel_message, "request done",
+            SLOG_KV_STR ("path", "/index.html"),
+            SLOG_KV_INT ("status", 200),
+            SLOG_KV_DOUBLE ("seconds", 0.0125),
+            SLOG_KV_BOOL ("cached", 0), NULL);
+    /* plain messages get the same structure */
+    slog_printf (stream, slog_loglevel_warning, "%d retries left", 2);
+
+    /* logfmt */
+    slog_format (stream, "%K");
+    slog_kv (stream, slog_loglevel_message, "request done",
+            SLOG_KV_STR ("path", "/index.html"), SLOG_KV_INT ("status", 200), NULL);
+
+    /* in a text format the fields follow the message */
+    slog_format (stream, "[%l] %L");
+    slog_kv (stream, slog_loglevel_message, "request done",
+            SLOG_KV_STR ("path", "/index.html"), SLOG_KV_INT ("status", 200), NULL);
+
+    slog_close (stream);
+    return check_keys ();
+}
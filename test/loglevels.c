@@ -6,7 +6,7 @@ static slog_loglevel myloglevel;
 static void myloglevel_print (slog_stream *stream, const char *, ...);
 
 int main (void) {
-    /* register the loglevel (thread unsafe btw) */
+    /* register the loglevel, it gets the next free index */
     slog_newloglevel (&myloglevel, "The prefix", slog_color_yellow, 1);
     /* the prefix is registered, create the logger and show the message */
     slog_stream *stream = slog_create (NULL, slog_flags_color);
@@ -0,0 +1,80 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+/* rotate.c - rotation by size, no line may be lost, even if the files
+ * cannot be renamed */
+
+#include "../slog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define NLINES 40
+#define MAX_FILES 16
+
+/* log NLINES lines to "<dir>/app.log" and check that each of them is in
+ * the file or one of the rotated ones */
+static int rotate (const char *dir, int blocked) {
+    char path[256], name[280], line[64];
+    char seen[NLINES] = { 0 };
+    snprintf (path, sizeof (path), "%s/app.log", dir);
+    /* "<path>.1" cannot be replaced, so the file cannot be moved away */
+    snprintf (name, sizeof (name), "%s.1", path);
+    if (blocked && mkdir (name, 0700) != 0)
+        return -1;
+
+    slog_stream *stream = slog_create (path, slog_flags_none);
+    if (!stream)
+        return -1;
+    slog_output_to_stdout (stream, 0);
+    slog_format (stream, "%L");
+    slog_rotation policy = { .max_bytes = 100, .max_files = blocked ? 1 : MAX_FILES };
+    if (slog_set_rotation (stream, &policy) != 0) {
+        slog_close (stream);
+        return -1;
+    }
+
+    int i, n, failed = 0;
+    for (i = 0; i < NLINES; ++i)
+        slog_printf (stream, slog_loglevel_message, "line %d", i);
+    slog_close (stream);
+
+    /* collect the lines and remove the files (and the directory) */
+    for (i = 0; i <= MAX_FILES; ++i) {
+        if (i)
+            snprintf (name, sizeof (name), "%s.%d", path, i);
+        else
+            snprintf (name, sizeof (name), "%s", path);
+        FILE *f = fopen (name, "r");
+        if (!f)
+            continue;
+        while (fgets (line, sizeof (line), f))
+            if (sscanf (line, "line %d", &n) == 1 && n >= 0 && n < NLINES)
+                seen[n] = 1;
+        fclose (f);
+        remove (name);
+    }
+
+    for (i = 0; i < NLINES; ++i) {
+        if (!seen[i]) {
+            printf ("line %d is lost%s\n", i, blocked ? " (blocked rotation)" : "");
+            failed = 1;
+        }
+    }
+    return failed;
+}
+
+int main (void) {
+    char dir[] = "/tmp/slog-rotate-XXXXXX";
+    if (!mkdtemp (dir))
+        return -1;
+
+    int failed = rotate (dir, 0) || rotate (dir, 1);
+    rmdir (dir);
+    return failed;
+}
@@ -0,0 +1,340 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+/* slog_bench - throughput and latency of the logging paths
+ *
+ * usage: slog_bench [-n messages] [-t threads] [-d dir]
+ *   -n messages  entries logged by each thread (default 200000)
+ *   -t threads   the largest number of threads, the runs use 1, 2, 4, ...
+ *                up to it (default: the number of CPUs)
+ *   -d dir       directory of the log files (default /tmp)
+ *
+ * The results go to stderr, so that the stdout runs can be redirected.
+ * Every path is compared with a plain fprintf () of a similar line, the
+ * messages are also compared with the C++ front end (see: slog.hpp).
+ * Allocations are counted by wrapping malloc () (glibc only). Latencies
+ * are measured around every call and include the cost of two clock reads. */
+
+#include "../slog.h"
+#include "../slog_fmt.h"
+#include "slog_bench.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_FORMAT  "[%l] %c: %L"
+#define BENCH_TOKEN_ITERATIONS 200000
+
+#ifdef __GLIBC__
+/* every allocation of the process, slog included, goes through here */
+extern void *__libc_malloc (size_t);
+extern void *__libc_calloc (size_t, size_t);
+extern void *__libc_realloc (void *, size_t);
+
+static atomic_ullong allocs;
+
+void *malloc (size_t n) {
+    atomic_fetch_add_explicit (&allocs, 1, memory_order_relaxed);
+    return __libc_malloc (n);
+}
+void *calloc (size_t n, size_t size) {
+    atomic_fetch_add_explicit (&allocs, 1, memory_order_relaxed);
+    return __libc_calloc (n, size);
+}
+void *realloc (void *p, size_t n) {
+    atomic_fetch_add_explicit (&allocs, 1, memory_order_relaxed);
+    return __libc_realloc (p, n);
+}
+#   define allocs_get() atomic_load (&allocs)
+#   define HAVE_ALLOCS 1
+#else
+#   define allocs_get() 0ull
+#   define HAVE_ALLOCS 0
+#endif
+
+typedef enum target {
+    target_devnull,
+    target_file,
+    target_stdout
+} target;
+
+/* a logging path */
+typedef struct path {
+    const char *name;
+    target to;
+    unsigned int flags;
+    /* the plain fprintf () baseline instead of slog */
+    int baseline;
+    /* the C++ front end instead of slog_printf () */
+    int cxx;
+} path;
+
+static const path paths[] = {
+    { "fprintf /dev/null",      target_devnull, 0, 1 },
+    { "slog /dev/null",         target_devnull, slog_flags_nostdout, 0 },
+    { "slog C++ /dev/null",     target_devnull, slog_flags_nostdout, 0, 1 },
+    { "fprintf file",           target_file,    0, 1 },
+    { "slog file",              target_file,    slog_flags_nostdout, 0 },
+    { "slog C++ file",          target_file,    slog_flags_nostdout, 0, 1 },
+    { "slog file async",        target_file,    slog_flags_nostdout | slog_flags_async, 0 },
+    { "slog file direct async", target_file,    slog_flags_nostdout | slog_flags_async | slog_flags_direct, 0 },
+    { "fprintf stdout",         target_stdout,  0, 1 },
+    { "slog stdout",            target_stdout,  0, 0 },
+};
+
+typedef struct run {
+    const path *p;
+    slog_stream *stream;
+    FILE *file;
+    long messages;
+    pthread_barrier_t start;
+} run;
+
+typedef struct worker {
+    run *r;
+    pthread_t thread;
+    /* latency of every call in nanoseconds */
+    uint32_t *lat;
+} worker;
+
+static long long now_ns (void) {
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void *work (void *arg) {
+    worker *w = arg;
+    run *r = w->r;
+    long i;
+
+    pthread_barrier_wait (&r->start);
+    for (i = 0; i < r->messages; ++i) {
+        long long t0 = now_ns ();
+        if (r->p->baseline) {
+            /* roughly the line slog writes with BENCH_FORMAT */
+            time_t t = time (NULL);
+            char ct[32];
+            ctime_r (&t, ct);
+            ct[24] = 0x0;
+            fprintf (r->file, "[Message] %s: " BENCH_MESSAGE "\n", ct, (int)i, BENCH_PAYLOAD);
+        } else if (r->p->cxx) {
+            bench_cxx (r->stream, 0, (int)i);
+        } else {
+            slog_printf (r->stream, slog_loglevel_message, BENCH_MESSAGE, (int)i, BENCH_PAYLOAD);
+        }
+        long long d = now_ns () - t0;
+        w->lat[i] = d > UINT32_MAX ? UINT32_MAX : (uint32_t)d;
+    }
+    return NULL;
+}
+
+static int cmp_u32 (const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* length of an entry, the number part varies a little */
+static size_t entry_len (void) {
+    slog_fmt *f = slog_fmt_create (BENCH_FORMAT);
+    char msg[64];
+    snprintf (msg, sizeof (msg), BENCH_MESSAGE, 100000, BENCH_PAYLOAD);
+    size_t n = slog_fmt_write (slog_loglevel_message, f, NULL, 0, msg) + 1;
+    slog_fmt_clear (f);
+    return n;
+}
+
+static int bench_path (const path *p, int nthreads, long messages, const char *dir) {
+    char name[4096];
+    snprintf (name, sizeof (name), "%s/slog_bench.log", dir);
+    const char *file = p->to == target_devnull ? "/dev/null" : name;
+
+    run r;
+    memset (&r, 0, sizeof (r));
+    r.p = p;
+    r.messages = messages;
+    if (p->baseline) {
+        r.file = p->to == target_stdout ? stdout : fopen (file, "w");
+        if (!r.file)
+            return 1;
+    } else {
+        r.stream = slog_create (p->to == target_stdout ? NULL : file, p->flags | slog_flags_rewrite);
+        if (!r.stream)
+            return 1;
+        slog_format (r.stream, BENCH_FORMAT);
+    }
+    pthread_barrier_init (&r.start, NULL, nthreads + 1);
+
+    worker *w = calloc (nthreads, sizeof (worker));
+    uint32_t *lat = malloc (sizeof (uint32_t) * messages * nthreads);
+    if (!w || !lat)
+        return 1;
+
+    int i;
+    for (i = 0; i < nthreads; ++i) {
+        w[i].r   = &r;
+        w[i].lat = lat + (size_t)i * messages;
+        pthread_create (&w[i].thread, NULL, work, &w[i]);
+    }
+
+    unsigned long long a0 = allocs_get ();
+    pthread_barrier_wait (&r.start);
+    long long t0 = now_ns ();
+    for (i = 0; i < nthreads; ++i)
+        pthread_join (w[i].thread, NULL);
+    /* everything queued counts */
+    if (r.stream)
+        slog_drain (r.stream);
+    else
+        fflush (r.file);
+    long long elapsed = now_ns () - t0;
+    unsigned long long a1 = allocs_get ();
+
+    if (r.stream)
+        slog_close (r.stream);
+    else if (r.file != stdout)
+        fclose (r.file);
+    pthread_barrier_destroy (&r.start);
+
+    size_t total = (size_t)messages * nthreads;
+    qsort (lat, total, sizeof (uint32_t), cmp_u32);
+    double secs = elapsed / 1e9;
+    fprintf (stderr, "%-24s %3d %12.0f %10.1f ", p->name, nthreads, total / secs, total * entry_len () / secs / 1e6);
+    if (HAVE_ALLOCS)
+        fprintf (stderr, "%8.3f ", (double)(a1 - a0) / total);
+    else
+        fprintf (stderr, "%8s ", "n/a");
+    fprintf (stderr, "%8u %8u %8u\n", lat[total / 2], lat[total * 99 / 100], lat[total * 999 / 1000]);
+
+    free (lat);
+    free (w);
+    if (p->to == target_file)
+        unlink (name);
+    return 0;
+}
+
+static char *get_str (slog_fmt *fmt, const char *mfmt, ...) {
+    va_list va;
+    va_start (va, mfmt);
+    char *s = slog_vfmt_get_str (slog_loglevel_message, fmt, mfmt, &va);
+    va_end (va);
+    return s;
+}
+
+/* slog_vfmt_get_str () with a format of a single token */
+static void bench_tokens (void) {
+    static const char tokens[] = "chHmsdMyYpPlLfuNTeJK";
+    const char *p;
+
+    fprintf (stderr, "%-8s %10s %10s\n", "token", "ns/op", "allocs/op");
+    for (p = tokens; *p; ++p) {
+        char str[3] = { '%', *p, 0x0 };
+        slog_fmt *fmt = slog_fmt_create (str);
+        if (!fmt)
+            continue;
+
+        int i;
+        unsigned long long a0 = allocs_get ();
+        long long t0 = now_ns ();
+        for (i = 0; i < BENCH_TOKEN_ITERATIONS; ++i)
+            free (get_str (fmt, BENCH_MESSAGE, i, BENCH_PAYLOAD));
+        long long elapsed = now_ns () - t0;
+        unsigned long long a1 = allocs_get ();
+
+        fprintf (stderr, "%-8s %10.1f ", str, (double)elapsed / BENCH_TOKEN_ITERATIONS);
+        if (HAVE_ALLOCS)
+            fprintf (stderr, "%10.3f\n", (double)(a1 - a0) / BENCH_TOKEN_ITERATIONS);
+        else
+            fprintf (stderr, "%10s\n", "n/a");
+        slog_fmt_clear (fmt);
+    }
+}
+
+static void bench_c (slog_stream *stream, int which, int i) {
+    if (which)
+        slog_message (stream, BENCH_NUMBERS, (unsigned int)i, i, i % 64, 64, i % 1000);
+    else
+        slog_message (stream, BENCH_MESSAGE, i, BENCH_PAYLOAD);
+}
+
+/* the message alone (layout "%L") to /dev/null, slog_printf () against
+ * the C++ front end */
+static int bench_messages (void) {
+    static const char *messages[] = { BENCH_MESSAGE, BENCH_NUMBERS };
+    slog_stream *stream = slog_create ("/dev/null", slog_flags_nostdout);
+    if (!stream)
+        return 1;
+    slog_format (stream, "%L");
+
+    fprintf (stderr, "\n%-36s %10s %10s\n", "message", "C ns/op", "C++ ns/op");
+    int which, i;
+    for (which = 0; which < 2; ++which) {
+        long long t0 = now_ns ();
+        for (i = 0; i < BENCH_TOKEN_ITERATIONS; ++i)
+            bench_c (stream, which, i);
+        long long t1 = now_ns ();
+        for (i = 0; i < BENCH_TOKEN_ITERATIONS; ++i)
+            bench_cxx (stream, which, i);
+        long long t2 = now_ns ();
+        fprintf (stderr, "%-36s %10.1f %10.1f\n", messages[which],
+                (double)(t1 - t0) / BENCH_TOKEN_ITERATIONS, (double)(t2 - t1) / BENCH_TOKEN_ITERATIONS);
+    }
+    slog_close (stream);
+    return 0;
+}
+
+int main (int argc, char **argv) {
+    long messages = 200000;
+    long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+    int max_threads = cpus > 0 ? (int)cpus : 1;
+    const char *dir = "/tmp";
+
+    int c;
+    while ((c = getopt (argc, argv, "n:t:d:")) != -1) {
+        switch (c) {
+            case 'n': messages = atol (optarg); break;
+            case 't': max_threads = atoi (optarg); break;
+            case 'd': dir = optarg; break;
+            default:
+                fprintf (stderr, "usage: slog_bench [-n messages] [-t threads] [-d dir]\n");
+                return 1;
+        }
+    }
+    if (messages < 1 || max_threads < 1) {
+        fprintf (stderr, "slog_bench: invalid arguments\n");
+        return 1;
+    }
+
+    bench_tokens ();
+    if (bench_messages () != 0) {
+        fprintf (stderr, "slog_bench: the messages failed\n");
+        return 1;
+    }
+
+    fprintf (stderr, "\n%-24s %3s %12s %10s %8s %8s %8s %8s\n", "path", "thr", "msgs/s", "MB/s",
+            "allocs", "p50 ns", "p99 ns", "p999 ns");
+    size_t i;
+    int n;
+    for (i = 0; i < sizeof (paths) / sizeof (paths[0]); ++i) {
+        for (n = 1; ; n *= 2) {
+            if (n > max_threads)
+                n = max_threads;
+            if (bench_path (&paths[i], n, messages, dir) != 0) {
+                fprintf (stderr, "slog_bench: %s failed\n", paths[i].name);
+                return 1;
+            }
+            if (n == max_threads)
+                break;
+        }
+    }
+    return 0;
+}
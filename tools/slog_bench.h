@@ -0,0 +1,32 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+/* slog_bench.h - the messages of slog_bench, shared by the C and the
+ * C++ (slog_bench_cxx.cpp) cases */
+
+#ifndef __SLOG_BENCH_H__
+#define __SLOG_BENCH_H__
+
+#include "../slog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BENCH_MESSAGE "bench message %d %s"
+#define BENCH_PAYLOAD "payload"
+/* a message of mostly numbers */
+#define BENCH_NUMBERS "id %u at %x: %d/%d items, %5d ms"
+
+/* bench_cxx - log message `which` (0: BENCH_MESSAGE, 1: BENCH_NUMBERS)
+ * through the C++ front end */
+void bench_cxx (slog_stream *stream, int which, int i);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
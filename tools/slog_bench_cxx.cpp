@@ -0,0 +1,17 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+/* slog_bench_cxx.cpp - the C++ front end cases of slog_bench */
+
+#include "slog_bench.h"
+#include "../slog.hpp"
+
+void bench_cxx (slog_stream *stream, int which, int i) {
+    if (which)
+        SLOG_LOG (stream, slog_loglevel_message, BENCH_NUMBERS, static_cast<unsigned int> (i), i, i % 64, 64, i % 1000);
+    else
+        SLOG_LOG (stream, slog_loglevel_message, BENCH_MESSAGE, i, BENCH_PAYLOAD);
+}
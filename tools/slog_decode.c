@@ -0,0 +1,349 @@
+/* This file is part of the slog library.
+ *
+ * Copyright (C) 2021 by Sergey Lafin
+ *
+ * Licensed under the LGPL v2.1, see the file LICENSE in base directory. */
+
+/* slog-decode - turn the output of a binary stream (see: slog_flags_binary)
+ * back into text.
+ *
+ * usage: slog-decode [-f layout] [file ...]
+ *   -f layout  render the entries with this slog_fmt layout instead of
+ *              the one recorded by the stream
+ * With no files the binary log is read from stdin. */
+
+#include "../slog_bin.h"
+#include "../slog_buf.h"
+#include "../slog_entry.h"
+#include "../slog_fmt.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* a dictionary of formats or level prefixes, indexed by id */
+typedef struct dict {
+    char **str;
+    size_t size;
+} dict;
+
+typedef struct decoder {
+    dict formats,
+         levels;
+    slog_fmt *layout;
+    /* the layout was given on the command line */
+    int fixed_layout;
+    slog_buf msg,
+             line;
+    /* the record being decoded */
+    char *rec;
+    size_t rec_size;
+    /* time of the first entry of the session, the elapsed time (%e)
+     * is not recorded and counts from here */
+    int64_t start;
+    int has_start;
+} decoder;
+
+static void dict_clear (dict *d) {
+    size_t i;
+    for (i = 0; i < d->size; ++i)
+        free (d->str[i]);
+    free (d->str);
+    d->str  = NULL;
+    d->size = 0;
+}
+
+static int dict_set (dict *d, uint32_t id, char *str) {
+    if (id >= d->size) {
+        size_t size = d->size ? d->size * 2 : 64;
+        while (size <= id)
+            size *= 2;
+        char **p = realloc (d->str, size * sizeof (char *));
+        if (!p)
+            return 1;
+        memset (p + d->size, 0, (size - d->size) * sizeof (char *));
+        d->str  = p;
+        d->size = size;
+    }
+    free (d->str[id]);
+    d->str[id] = str;
+    return 0;
+}
+
+static const char *dict_get (const dict *d, uint32_t id) {
+    return id < d->size ? d->str[id] : NULL;
+}
+
+static int read_n (FILE *in, void *p, size_t n) {
+    return fread (p, 1, n, in) == n ? 0 : 1;
+}
+static int read_u32 (FILE *in, uint32_t *v) {
+    return read_n (in, v, sizeof (*v));
+}
+
+/* read `len` bytes of a record into the decoder's buffer */
+static char *read_rec (decoder *d, FILE *in, size_t len) {
+    if (len + 1 > d->rec_size) {
+        char *p = realloc (d->rec, len + 1);
+        if (!p)
+            return NULL;
+        d->rec = p;
+        d->rec_size = len + 1;
+    }
+    if (read_n (in, d->rec, len) != 0)
+        return NULL;
+    d->rec[len] = 0x0;
+    return d->rec;
+}
+
+/* read a length-prefixed string into a new allocation */
+static char *read_str (FILE *in) {
+    uint32_t len;
+    if (read_u32 (in, &len) != 0)
+        return NULL;
+    char *s = malloc ((size_t)len + 1);
+    if (!s)
+        return NULL;
+    if (read_n (in, s, len) != 0) {
+        free (s);
+        return NULL;
+    }
+    s[len] = 0x0;
+    return s;
+}
+
+static int set_layout (decoder *d, const char *layout) {
+    slog_fmt *f = slog_fmt_create (layout);
+    if (!f)
+        return 1;
+    if (d->layout)
+        slog_fmt_clear (d->layout);
+    d->layout = f;
+    return 0;
+}
+
+/* append the output of a single conversion */
+static void put_conv (slog_buf *out, const char *conv, ...) {
+    va_list list;
+    va_start (list, conv);
+    slog_buf_vprintf (out, conv, &list);
+    va_end (list);
+}
+
+/* take `n` bytes of the arguments */
+#define take(dst, n) {\
+    if (left < (n))\
+        return 1;\
+    memcpy ((dst), args, (n));\
+    args += (n);\
+    left -= (n);\
+}
+
+/* format a message from its format and the recorded arguments */
+static int decode_message (slog_buf *out, const char *fmt, const char *args, size_t left) {
+    slog_bin_spec spec;
+    const char *p = fmt, *next;
+
+    while ((next = slog_bin_next (p, &spec)) != NULL) {
+        slog_buf_append (out, p, spec.start - p);
+        p = next;
+
+        if (spec.arg == slog_bin_arg_none) {
+            slog_buf_append (out, "%", 1);
+            continue;
+        }
+
+        int width = spec.width,
+            prec  = spec.prec;
+        if (spec.star_width)
+            take (&width, sizeof (width));
+        if (spec.star_prec)
+            take (&prec, sizeof (prec));
+
+        /* the conversion without the stars */
+        char conv[64];
+        int n = snprintf (conv, sizeof (conv), "%%%s%s", spec.flags, width < 0 && spec.star_width ? "-" : "");
+        if (width >= 0 || spec.star_width)
+            n += snprintf (conv + n, sizeof (conv) - n, "%d", width < 0 ? -width : width);
+        if (prec >= 0)
+            n += snprintf (conv + n, sizeof (conv) - n, ".%d", prec);
+        snprintf (conv + n, sizeof (conv) - n, "%s%c", spec.length, spec.conv);
+
+#define put_arg(type) {\
+    type v;\
+    take (&v, sizeof (v));\
+    put_conv (out, conv, v);\
+    break;\
+}
+        switch (spec.arg) {
+            case slog_bin_arg_int:     put_arg (int)
+            case slog_bin_arg_long:    put_arg (long)
+            case slog_bin_arg_llong:   put_arg (long long)
+            case slog_bin_arg_intmax:  put_arg (intmax_t)
+            case slog_bin_arg_size:    put_arg (size_t)
+            case slog_bin_arg_ptrdiff: put_arg (ptrdiff_t)
+            case slog_bin_arg_double:  put_arg (double)
+            case slog_bin_arg_ldouble: put_arg (long double)
+            case slog_bin_arg_ptr:     put_arg (void *)
+            case slog_bin_arg_str: {
+                uint32_t len;
+                take (&len, sizeof (len));
+                if (len == SLOG_BIN_NULLSTR) {
+                    put_conv (out, conv, (const char *)NULL);
+                    break;
+                }
+                if (left < len)
+                    return 1;
+                /* the recorded bytes are not terminated */
+                char *s = malloc ((size_t)len + 1);
+                if (!s)
+                    return 1;
+                memcpy (s, args, len);
+                s[len] = 0x0;
+                args += len;
+                left -= len;
+                put_conv (out, conv, s);
+                free (s);
+                break;
+            }
+            default:
+                return 1;
+        }
+#undef put_arg
+    }
+    slog_buf_append (out, p, strlen (p));
+    return 0;
+}
+#undef take
+
+/* render and print an entry */
+static void print_entry (decoder *d, uint32_t level_id, int64_t sec, uint32_t nsec, const char *message) {
+    const char *prefix = dict_get (&d->levels, level_id);
+    slog_loglevel level = { prefix ? prefix : "?", slog_color_white, 0, 0 };
+    slog_entry e = { &level, message, NULL };
+    e.ts.tv_sec  = sec;
+    e.ts.tv_nsec = nsec;
+    e.has_time   = 1;
+
+    int64_t ns = sec * 1000000000LL + nsec;
+    if (!d->has_start) {
+        d->start = ns;
+        d->has_start = 1;
+    }
+    e.elapsed     = ns - d->start;
+    e.has_elapsed = 1;
+
+    d->line.len = 0;
+    if (slog_fmt_entry (&d->line, d->layout, &e) == 0) {
+        d->line.data[d->line.len++] = '\n';
+        fwrite (d->line.data, 1, d->line.len, stdout);
+    }
+}
+
+static int decode (decoder *d, FILE *in, const char *name) {
+    int type;
+    while ((type = getc (in)) != EOF) {
+        uint32_t id, fmt_id, level_id, nsec, len;
+        int64_t sec;
+        char *s;
+
+        switch (type) {
+            case slog_bin_rec_session: {
+                char magic[8];
+                if (read_n (in, magic, 8) != 0 || memcmp (magic, SLOG_BIN_MAGIC, 8) != 0)
+                    goto corrupt;
+                dict_clear (&d->formats);
+                dict_clear (&d->levels);
+                d->has_start = 0;
+                break;
+            }
+            case slog_bin_rec_layout:
+                if (!(s = read_str (in)))
+                    goto corrupt;
+                if (!d->fixed_layout && set_layout (d, s) != 0) {
+                    free (s);
+                    goto corrupt;
+                }
+                free (s);
+                break;
+            case slog_bin_rec_format:
+            case slog_bin_rec_level:
+                if (read_u32 (in, &id) != 0 || !(s = read_str (in)))
+                    goto corrupt;
+                dict_set (type == slog_bin_rec_format ? &d->formats : &d->levels, id, s);
+                break;
+            case slog_bin_rec_entry: {
+                if (read_u32 (in, &fmt_id) != 0 || read_u32 (in, &level_id) != 0
+                        || read_n (in, &sec, sizeof (sec)) != 0 || read_u32 (in, &nsec) != 0
+                        || read_u32 (in, &len) != 0 || !(s = read_rec (d, in, len)))
+                    goto corrupt;
+                const char *fmt = dict_get (&d->formats, fmt_id);
+                if (!fmt)
+                    goto corrupt;
+
+                d->msg.len = 0;
+                if (decode_message (&d->msg, fmt, s, len) != 0)
+                    goto corrupt;
+                slog_buf_terminate (&d->msg);
+                print_entry (d, level_id, sec, nsec, d->msg.data);
+                break;
+            }
+            case slog_bin_rec_text:
+                if (read_u32 (in, &level_id) != 0 || read_n (in, &sec, sizeof (sec)) != 0
+                        || read_u32 (in, &nsec) != 0 || read_u32 (in, &len) != 0
+                        || !(s = read_rec (d, in, len)))
+                    goto corrupt;
+                print_entry (d, level_id, sec, nsec, s);
+                break;
+            default:
+                goto corrupt;
+        }
+    }
+    return 0;
+
+corrupt:
+    fprintf (stderr, "slog-decode: %s: corrupt or truncated record at offset %ld\n", name, ftell (in));
+    return 1;
+}
+
+int main (int argc, char **argv) {
+    decoder d;
+    memset (&d, 0, sizeof (d));
+    if (slog_buf_init (&d.msg, NULL, 0) != 0 || slog_buf_init (&d.line, NULL, 0) != 0)
+        return 1;
+
+    int i = 1, status = 0;
+    if (i + 1 < argc && strcmp (argv[i], "-f") == 0) {
+        if (set_layout (&d, argv[i + 1]) != 0) {
+            fprintf (stderr, "slog-decode: invalid layout %s\n", argv[i + 1]);
+            return 1;
+        }
+        d.fixed_layout = 1;
+        i += 2;
+    } else if (set_layout (&d, "[%l] %c: %L") != 0) {
+        return 1;
+    }
+
+    if (i == argc)
+        status = decode (&d, stdin, "stdin");
+    for (; i < argc; ++i) {
+        FILE *in = fopen (argv[i], "rb");
+        if (!in) {
+            fprintf (stderr, "slog-decode: cannot open %s\n", argv[i]);
+            status = 1;
+            continue;
+        }
+        status |= decode (&d, in, argv[i]);
+        fclose (in);
+    }
+
+    dict_clear (&d.formats);
+    dict_clear (&d.levels);
+    slog_fmt_clear (d.layout);
+    free (d.msg.data);
+    free (d.line.data);
+    free (d.rec);
+    return status;
+}